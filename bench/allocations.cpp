@@ -0,0 +1,54 @@
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+#include "allocations.hpp"
+
+namespace{
+    std::atomic<uint64_t> total_count = 0;
+    std::atomic<uint64_t> total_bytes = 0;
+}
+
+namespace allocations{
+    uint64_t count(){
+        return total_count.load(std::memory_order_relaxed);
+    }
+
+    uint64_t bytes(){
+        return total_bytes.load(std::memory_order_relaxed);
+    }
+}
+
+// every allocation of the program goes through these. They are in their
+// own file so that the compiler doesn't pair the malloc and free below with
+// the new and delete of the benchmarks
+void* operator new(size_t n){
+    total_count.fetch_add(1, std::memory_order_relaxed);
+    total_bytes.fetch_add(n, std::memory_order_relaxed);
+
+    if(void* p = std::malloc(n == 0 ? 1 : n)){
+        return p;
+    }
+
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t n){
+    return operator new(n);
+}
+
+void operator delete(void* p) noexcept{
+    std::free(p);
+}
+
+void operator delete[](void* p) noexcept{
+    operator delete(p);
+}
+
+void operator delete(void* p, size_t) noexcept{
+    operator delete(p);
+}
+
+void operator delete[](void* p, size_t) noexcept{
+    operator delete(p);
+}
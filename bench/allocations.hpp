@@ -0,0 +1,13 @@
+#ifndef _MY_BENCH_ALLOCATIONS_
+#define _MY_BENCH_ALLOCATIONS_
+
+#include <cstdint>
+
+// totals since the start of the program, counted by the replaced global
+// operator new of allocations.cpp
+namespace allocations{
+    uint64_t count();
+    uint64_t bytes();
+}
+
+#endif
@@ -0,0 +1,40 @@
+# Times the compilation of SOURCE once per variant.
+#
+#   cmake -DCXX=<compiler> -DINCLUDES=<dir|dir> -DSOURCE=<file>
+#         -DVARIANTS=<name[=DEFINE]|...> -P compile_time.cmake
+#
+# Lists are separated by '|' so they survive add_custom_target.
+
+string(REPLACE "|" ";" INCLUDES "${INCLUDES}")
+string(REPLACE "|" ";" VARIANTS "${VARIANTS}")
+
+set(include_flags)
+foreach(dir IN LISTS INCLUDES)
+    list(APPEND include_flags "-I${dir}")
+endforeach()
+
+foreach(variant IN LISTS VARIANTS)
+    string(REPLACE "=" ";" parts "${variant}")
+    list(GET parts 0 name)
+    list(LENGTH parts n_parts)
+
+    set(define_flags)
+    if(n_parts GREATER 1)
+        list(GET parts 1 define)
+        set(define_flags "-D${define}")
+    endif()
+
+    string(TIMESTAMP start "%s%f")
+    execute_process(
+        COMMAND ${CXX} -std=c++23 -fsyntax-only ${include_flags} ${define_flags} ${SOURCE}
+        RESULT_VARIABLE result
+    )
+    string(TIMESTAMP stop "%s%f")
+
+    if(NOT result EQUAL 0)
+        message(FATAL_ERROR "${name}: compilation failed")
+    endif()
+
+    math(EXPR elapsed_ms "(${stop} - ${start}) / 1000")
+    message(STATUS "${name}: ${elapsed_ms} ms")
+endforeach()
@@ -0,0 +1,30 @@
+// Lexes a long expression during constant evaluation with the default lexer
+// backend. calc_bench_constexpr compiles this file once per backend: the
+// difference in compile time is the cost of the lexer in constexpr contexts.
+
+#include "constexpr-calculator/calculator.hpp"
+
+constexpr size_t count_tokens(size_t terms){
+    std::string expr = "1";
+    for(size_t i = 0; i < terms; ++i){
+        expr += " + abs(12.5) * floor(3) - ceil(.75) / (4 ^ 2)!";
+    }
+
+    calc::tokenizer t;
+    if(t.tokenize(expr)){
+        return 0;
+    }
+
+    size_t n = 0;
+    while(t.next()){
+        ++n;
+    }
+
+    return n;
+}
+
+static_assert(count_tokens(20) == 441);
+static_assert(count_tokens(40) == 881);
+static_assert(count_tokens(80) == 1761);
+
+int main(){}
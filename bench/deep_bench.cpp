@@ -0,0 +1,74 @@
+#include "benchmark/benchmark.h"
+
+#include "constexpr-calculator/calculator.hpp"
+
+namespace{
+    // state.range(0) nested brackets, about 2 nodes per level
+    std::string make_nested(int64_t depth){
+        std::string ret;
+        for(int64_t i = 0; i < depth; ++i){
+            ret += i % 2 ? "-(" : "abs(";
+        }
+        ret += "x";
+        ret += std::string(static_cast<size_t>(depth), ')');
+
+        return ret;
+    }
+
+    // state.range(0) terms, 2 nodes per term
+    std::string make_chain(int64_t terms){
+        std::string ret = "x";
+        for(int64_t i = 0; i < terms; ++i){
+            ret += i % 2 ? " + 2" : " * 1";
+        }
+
+        return ret;
+    }
+
+    template<std::string(*make)(int64_t)>
+    void BM_parse_deep(benchmark::State& state){
+        const auto str = make(state.range(0));
+
+        for(auto _ : state){
+            auto c = calc::compile(str);
+            benchmark::DoNotOptimize(c);
+        }
+
+        state.SetItemsProcessed(state.iterations() * state.range(0));
+    }
+
+    template<std::string(*make)(int64_t)>
+    void BM_evaluate_deep(benchmark::State& state){
+        const auto input = make(state.range(0));
+        const auto c = calc::compile(input);
+
+        for(auto _ : state){
+            auto res = c->evaluate({1.5});
+            benchmark::DoNotOptimize(res);
+        }
+
+        state.SetItemsProcessed(state.iterations() * state.range(0));
+    }
+
+    template<std::string(*make)(int64_t)>
+    void BM_evaluate_tree_deep(benchmark::State& state){
+        const auto input = make(state.range(0));
+        const auto c = calc::compile(input);
+        const std::array<calc::num_t, 1> values{1.5};
+
+        for(auto _ : state){
+            auto res = c->evaluate_tree(values);
+            benchmark::DoNotOptimize(res);
+        }
+
+        state.SetItemsProcessed(state.iterations() * state.range(0));
+    }
+}
+
+// up to a million nodes
+BENCHMARK(BM_parse_deep<make_nested>)->RangeMultiplier(10)->Range(1000, 500000)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_parse_deep<make_chain>)->RangeMultiplier(10)->Range(1000, 500000)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_evaluate_deep<make_nested>)->RangeMultiplier(10)->Range(1000, 500000)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_evaluate_deep<make_chain>)->RangeMultiplier(10)->Range(1000, 500000)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_evaluate_tree_deep<make_nested>)->RangeMultiplier(10)->Range(1000, 500000)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_evaluate_tree_deep<make_chain>)->RangeMultiplier(10)->Range(1000, 500000)->Unit(benchmark::kMillisecond);
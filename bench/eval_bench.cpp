@@ -0,0 +1,157 @@
+#include "benchmark/benchmark.h"
+
+#include "constexpr-calculator/calculator.hpp"
+#include "constexpr-calculator/jit_expression.hpp"
+
+namespace{
+    std::string make_formula(int64_t terms){
+        std::string ret = "x";
+        for(int64_t i = 0; i < terms; ++i){
+            ret += " + x * x - 3 * y / (abs(x - y) + 1) + floor(y) ^ 2";
+        }
+
+        return ret;
+    }
+
+    void BM_evaluate_tree(benchmark::State& state){
+        const auto formula = make_formula(state.range(0));
+        const auto c = calc::compile(formula, {"x", "y"});
+        const std::array<calc::num_t, 2> values{1.5, -2.25};
+
+        for(auto _ : state){
+            auto res = c->evaluate_tree(values);
+            benchmark::DoNotOptimize(res);
+        }
+
+        state.SetItemsProcessed(state.iterations());
+    }
+
+    void BM_evaluate_bytecode(benchmark::State& state){
+        const auto formula = make_formula(state.range(0));
+        const auto c = calc::compile(formula, {"x", "y"});
+        const std::array<calc::num_t, 2> values{1.5, -2.25};
+
+        for(auto _ : state){
+            auto res = c->evaluate(values);
+            benchmark::DoNotOptimize(res);
+        }
+
+        state.SetItemsProcessed(state.iterations());
+    }
+
+    // the bytecode checked at every instruction, evaluate() only checks
+    // the result
+    void BM_evaluate_bytecode_checked(benchmark::State& state){
+        const auto formula = make_formula(state.range(0));
+        const auto c = calc::compile(formula, {"x", "y"});
+        const std::array<calc::num_t, 2> values{1.5, -2.25};
+        std::vector<calc::num_t> scratch(c->bytecode().scratch_size());
+
+        for(auto _ : state){
+            auto res = c->bytecode().run(c->expression(), values, scratch);
+            benchmark::DoNotOptimize(res);
+        }
+
+        state.SetItemsProcessed(state.iterations());
+    }
+
+    void BM_evaluate_jit(benchmark::State& state){
+        const auto formula = make_formula(state.range(0));
+        const auto c = calc::compile(formula, {"x", "y"});
+        const calc::jit_expression j(*c);
+        const std::array<calc::num_t, 2> values{1.5, -2.25};
+        if(!j.native()){
+            state.SkipWithError("no native code on this platform");
+            return;
+        }
+
+        for(auto _ : state){
+            auto res = j.evaluate(values);
+            benchmark::DoNotOptimize(res);
+        }
+
+        state.SetItemsProcessed(state.iterations());
+    }
+
+    // one row at a time against whole columns, state.range(0) rows
+    void BM_rows_bytecode(benchmark::State& state){
+        const auto formula = make_formula(4);
+        const auto c = calc::compile(formula, {"x", "y"});
+        const auto rows = static_cast<size_t>(state.range(0));
+        std::vector<calc::num_t> xs(rows, 1.5), ys(rows, -2.25), out(rows);
+
+        for(auto _ : state){
+            for(size_t i = 0; i < rows; ++i){
+                out[i] = c->evaluate({xs[i], ys[i]}).value_or(0);
+            }
+            benchmark::DoNotOptimize(out.data());
+        }
+
+        state.SetItemsProcessed(state.iterations() * state.range(0));
+    }
+
+    void BM_rows_batch(benchmark::State& state){
+        const auto formula = make_formula(4);
+        const auto c = calc::compile(formula, {"x", "y"});
+        const auto rows = static_cast<size_t>(state.range(0));
+        std::vector<calc::num_t> xs(rows, 1.5), ys(rows, -2.25), out(rows);
+        std::vector<calc::lane_err> errors(rows);
+        const std::array<std::span<const calc::num_t>, 2> columns{xs, ys};
+
+        for(auto _ : state){
+            auto err = c->evaluate_batch(columns, out, errors);
+            benchmark::DoNotOptimize(err);
+            benchmark::DoNotOptimize(out.data());
+        }
+
+        state.SetItemsProcessed(state.iterations() * state.range(0));
+    }
+
+    // request stream where 4 expressions out of 5 were already seen
+    std::vector<std::string> make_requests(size_t n){
+        std::vector<std::string> ret;
+        for(size_t i = 0; i < n; ++i){
+            const size_t id = i % 5 == 0 ? i : i % 50;
+            ret.push_back(std::to_string(id) + " * 2.5 + abs(3 - " + std::to_string(id % 7) + ") ^ 2");
+        }
+
+        return ret;
+    }
+
+    void BM_requests_uncached(benchmark::State& state){
+        const auto requests = make_requests(4096);
+
+        for(auto _ : state){
+            for(const auto& r : requests){
+                auto v = calc::evaluate(r);
+                benchmark::DoNotOptimize(v);
+            }
+        }
+
+        state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(requests.size()));
+    }
+
+    void BM_requests_cached(benchmark::State& state){
+        const auto requests = make_requests(4096);
+        // the repeated expressions fit, the others keep being evicted
+        calc::evaluation_cache cache(256);
+
+        for(auto _ : state){
+            for(const auto& r : requests){
+                auto v = cache.get(r);
+                benchmark::DoNotOptimize(v);
+            }
+        }
+
+        state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(requests.size()));
+    }
+}
+
+BENCHMARK(BM_evaluate_tree)->RangeMultiplier(8)->Range(1, 512);
+BENCHMARK(BM_evaluate_bytecode)->RangeMultiplier(8)->Range(1, 512);
+BENCHMARK(BM_evaluate_bytecode_checked)->RangeMultiplier(8)->Range(1, 512);
+BENCHMARK(BM_evaluate_jit)->RangeMultiplier(8)->Range(1, 512);
+BENCHMARK(BM_rows_bytecode)->RangeMultiplier(100)->Range(100, 1000000);
+BENCHMARK(BM_rows_batch)->RangeMultiplier(100)->Range(100, 1000000);
+BENCHMARK(BM_requests_uncached);
+BENCHMARK(BM_requests_cached);
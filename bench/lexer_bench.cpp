@@ -0,0 +1,36 @@
+#include "benchmark/benchmark.h"
+
+#include "constexpr-calculator/calculator.hpp"
+
+namespace{
+    std::string make_expression(int64_t terms){
+        std::string ret = "1";
+        for(int64_t i = 0; i < terms; ++i){
+            ret += " + abs(12.5) * floor(3) - ceil(.75) / (4 ^ 2)!";
+        }
+
+        return ret;
+    }
+
+    template<typename lexer>
+    void BM_tokenize(benchmark::State& state){
+        const auto expr = make_expression(state.range(0));
+
+        for(auto _ : state){
+            calc::basic_tokenizer<lexer> t;
+            auto err = t.tokenize(expr);
+            benchmark::DoNotOptimize(err);
+
+            size_t n = 0;
+            while(t.next()){
+                ++n;
+            }
+            benchmark::DoNotOptimize(n);
+        }
+
+        state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(expr.size()));
+    }
+}
+
+BENCHMARK_TEMPLATE(BM_tokenize, calc::ctre_lexer)->RangeMultiplier(8)->Range(1, 4096);
+BENCHMARK_TEMPLATE(BM_tokenize, calc::table_lexer)->RangeMultiplier(8)->Range(1, 4096);
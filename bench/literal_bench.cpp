@@ -0,0 +1,92 @@
+#include <charconv>
+#include <cstdio>
+#include <random>
+
+#include "benchmark/benchmark.h"
+
+#include "constexpr-calculator/calculator.hpp"
+
+namespace{
+    // printf formats of the literals: short decimals, full precision and
+    // scientific notation as sent by the feeds
+    constexpr std::array formats{"%.3f", "%.17g", "%.6e"};
+
+    std::vector<std::string> make_literals(size_t format, size_t n){
+        std::mt19937_64 rng(42);
+        std::uniform_real_distribution<double> mantissa(0, 10);
+        std::uniform_int_distribution<int> exponent(-30, 30);
+
+        std::vector<std::string> ret;
+        for(size_t i = 0; i < n; ++i){
+            std::array<char, 64> buf{};
+            const double v = mantissa(rng) * std::pow(10., format == 0 ? 2 : exponent(rng));
+            std::snprintf(buf.data(), buf.size(), formats[format], v);
+            ret.emplace_back(buf.data());
+        }
+
+        return ret;
+    }
+
+    size_t total_size(const std::vector<std::string>& literals){
+        size_t ret = 0;
+        for(const auto& l : literals){
+            ret += l.size();
+        }
+
+        return ret;
+    }
+
+    void BM_number_parser(benchmark::State& state){
+        const auto literals = make_literals(static_cast<size_t>(state.range(0)), 4096);
+
+        for(auto _ : state){
+            for(const auto& l : literals){
+                auto v = calc::number_parser::parse(l);
+                benchmark::DoNotOptimize(v);
+            }
+        }
+
+        state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(literals.size()));
+        state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(total_size(literals)));
+    }
+
+    // reference
+    void BM_from_chars(benchmark::State& state){
+        const auto literals = make_literals(static_cast<size_t>(state.range(0)), 4096);
+
+        for(auto _ : state){
+            for(const auto& l : literals){
+                double v = 0;
+                auto res = std::from_chars(l.data(), l.data() + l.size(), v);
+                benchmark::DoNotOptimize(res);
+                benchmark::DoNotOptimize(v);
+            }
+        }
+
+        state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(literals.size()));
+        state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(total_size(literals)));
+    }
+
+    // whole expression made of literals: lexing, parsing and conversion
+    void BM_compile_literals(benchmark::State& state){
+        const auto literals = make_literals(static_cast<size_t>(state.range(0)), 4096);
+
+        std::string expr = "0";
+        for(const auto& l : literals){
+            expr += " + " + l;
+        }
+
+        for(auto _ : state){
+            auto c = calc::compile(expr);
+            benchmark::DoNotOptimize(c);
+        }
+
+        state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(literals.size()));
+        state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(expr.size()));
+    }
+}
+
+// the argument is the index in formats
+BENCHMARK(BM_number_parser)->DenseRange(0, formats.size() - 1);
+BENCHMARK(BM_from_chars)->DenseRange(0, formats.size() - 1);
+BENCHMARK(BM_compile_literals)->DenseRange(0, formats.size() - 1);
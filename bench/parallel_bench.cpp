@@ -0,0 +1,49 @@
+#include <thread>
+
+#include "benchmark/benchmark.h"
+
+#include "constexpr-calculator/calculator.hpp"
+
+namespace{
+    // batch of state.range(1) rows split among state.range(0) threads
+    void BM_parallel_batch(benchmark::State& state){
+        const auto c = calc::compile(
+            "x * x - 3 * y / (abs(x - y) + 1) + floor(y) * ceil(x) - y / x", 
+            {"x", "y"}
+        );
+        const auto rows = static_cast<size_t>(state.range(1));
+        std::vector<calc::num_t> xs(rows), ys(rows), out(rows);
+        std::vector<calc::lane_err> errors(rows);
+        for(size_t i = 0; i < rows; ++i){
+            xs[i] = static_cast<calc::num_t>(i % 101) * 0.5;
+            ys[i] = static_cast<calc::num_t>(i % 37) - 18;
+        }
+        const std::array<std::span<const calc::num_t>, 2> columns{xs, ys};
+
+        calc::thread_pool pool(static_cast<size_t>(state.range(0)));
+
+        for(auto _ : state){
+            auto err = c->evaluate_batch(columns, out, errors, pool);
+            benchmark::DoNotOptimize(err);
+            benchmark::DoNotOptimize(out.data());
+        }
+
+        state.SetItemsProcessed(state.iterations() * state.range(1));
+    }
+
+    // from 1 thread to one per core
+    void thread_counts(benchmark::internal::Benchmark* b){
+        const int cores = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+
+        for(int rows : {1'000'000, 10'000'000}){
+            for(int t = 1; t <= cores; t *= 2){
+                b->Args({t, rows});
+            }
+            if((cores & (cores - 1)) != 0){
+                b->Args({cores, rows});
+            }
+        }
+    }
+}
+
+BENCHMARK(BM_parallel_batch)->Apply(thread_counts)->UseRealTime()->Unit(benchmark::kMillisecond);
@@ -0,0 +1,192 @@
+// cost of each stage on its own: tokenizing, parsing and evaluating, over
+// expressions of different shapes. Every benchmark reports the heap
+// allocations per call besides bytes/s and expressions/s
+
+#include "benchmark/benchmark.h"
+
+#include "constexpr-calculator/calculator.hpp"
+
+#include "allocations.hpp"
+
+namespace{
+    // shape of the generated expressions, one benchmark argument each
+    struct shape{
+        // operands at the top level
+        int64_t terms;
+        // brackets around each operand, each with its own operator
+        int64_t depth;
+        // index in mixes
+        int64_t mix;
+        // digits of each literal
+        int64_t digits;
+    };
+
+    // operators joining the operands. Every operand is a non zero literal
+    // or x, the operands of '!' are small integers: nothing fails
+    constexpr std::array<std::array<std::string_view, 4>, 4> mixes{{
+        // additive
+        {" + ", " - ", " + ", " - "},
+        // multiplicative
+        {" * ", " / ", " * ", " / "},
+        // functions and powers, which join the operands with '+'
+        {" + abs(", " + floor(", " + 3! * ceil(", " + 2 ^ floor("},
+        // all of them
+        {" + ", " * ", " - abs(", " / "},
+    }};
+
+    std::string make_literal(int64_t digits, int64_t i){
+        std::string ret;
+        for(int64_t d = 0; d < digits; ++d){
+            if(d == 1){
+                ret += '.';
+            }
+            ret += static_cast<char>('1' + (i + d) % 9);
+        }
+
+        return ret;
+    }
+
+    std::string make_operand(const shape& s, int64_t i){
+        std::string ret;
+        for(int64_t d = 0; d < s.depth; ++d){
+            ret += "(" + make_literal(s.digits, i + d) + (d % 2 ? " * " : " - ");
+        }
+        ret += i % 3 ? make_literal(s.digits, i + s.depth) : "x";
+        ret += std::string(static_cast<size_t>(s.depth), ')');
+
+        return ret;
+    }
+
+    std::string make_expression(const benchmark::State& state){
+        const shape s{state.range(0), state.range(1), state.range(2), state.range(3)};
+        const auto& ops = mixes[static_cast<size_t>(s.mix)];
+
+        std::string ret = make_operand(s, 0);
+        for(int64_t i = 1; i < s.terms; ++i){
+            const auto op = ops[static_cast<size_t>(i) % ops.size()];
+            ret += op;
+            ret += make_operand(s, i);
+            if(op.ends_with('(')){
+                ret += ')';
+            }
+        }
+
+        return ret;
+    }
+
+    // allocations of the timed loop, per iteration
+    class allocation_counter{
+        uint64_t start_count = allocations::count();
+        uint64_t start_bytes = allocations::bytes();
+
+    public:
+        void report(benchmark::State& state) const {
+            const auto count = static_cast<double>(allocations::count() - start_count);
+            const auto bytes = static_cast<double>(allocations::bytes() - start_bytes);
+
+            state.counters["allocs"] = benchmark::Counter(count, benchmark::Counter::kAvgIterations);
+            state.counters["alloc_bytes"] = benchmark::Counter(bytes, benchmark::Counter::kAvgIterations);
+        }
+    };
+
+    void report(benchmark::State& state, const std::string& expr){
+        state.SetItemsProcessed(state.iterations());
+        state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(expr.size()));
+    }
+
+    void BM_stage_tokenize(benchmark::State& state){
+        const auto expr = make_expression(state);
+        calc::tokenizer t;
+
+        const allocation_counter allocs;
+        for(auto _ : state){
+            auto err = t.tokenize(expr);
+            benchmark::DoNotOptimize(err);
+
+            size_t n = 0;
+            while(t.next()){
+                ++n;
+            }
+            benchmark::DoNotOptimize(n);
+        }
+        allocs.report(state);
+
+        report(state, expr);
+    }
+
+    // parsing includes the lowering to bytecode
+    void BM_stage_parse(benchmark::State& state){
+        const auto expr = make_expression(state);
+        calc::parser p;
+
+        const allocation_counter allocs;
+        for(auto _ : state){
+            auto c = p.compile(expr);
+            benchmark::DoNotOptimize(c);
+        }
+        allocs.report(state);
+
+        report(state, expr);
+    }
+
+    void BM_stage_evaluate(benchmark::State& state){
+        const auto expr = make_expression(state);
+        const auto c = calc::compile(expr);
+        if(!c || !c->evaluate({1.5})){
+            state.SkipWithError("the expression doesn't evaluate");
+            return;
+        }
+
+        const allocation_counter allocs;
+        for(auto _ : state){
+            auto res = c->evaluate({1.5});
+            benchmark::DoNotOptimize(res);
+        }
+        allocs.report(state);
+
+        report(state, expr);
+    }
+
+    void BM_stage_evaluate_tree(benchmark::State& state){
+        const auto expr = make_expression(state);
+        const auto c = calc::compile(expr);
+        const std::array<calc::num_t, 1> values{1.5};
+        if(!c || !c->evaluate_tree(values)){
+            state.SkipWithError("the expression doesn't evaluate");
+            return;
+        }
+
+        const allocation_counter allocs;
+        for(auto _ : state){
+            auto res = c->evaluate_tree(values);
+            benchmark::DoNotOptimize(res);
+        }
+        allocs.report(state);
+
+        report(state, expr);
+    }
+
+    // one parameter at a time around 16 terms, no brackets, all the
+    // operators and 3 digits per literal
+    void shapes(benchmark::internal::Benchmark* b){
+        b->ArgNames({"terms", "depth", "mix", "digits"});
+
+        for(int64_t terms : {1, 16, 256, 4096}){
+            b->Args({terms, 0, 3, 3});
+        }
+        for(int64_t depth : {1, 4, 16, 64}){
+            b->Args({16, depth, 3, 3});
+        }
+        for(int64_t mix = 0; mix < static_cast<int64_t>(mixes.size()) - 1; ++mix){
+            b->Args({16, 0, mix, 3});
+        }
+        for(int64_t digits : {1, 8, 17, 40}){
+            b->Args({16, 0, 3, digits});
+        }
+    }
+}
+
+BENCHMARK(BM_stage_tokenize)->Apply(shapes);
+BENCHMARK(BM_stage_parse)->Apply(shapes);
+BENCHMARK(BM_stage_evaluate)->Apply(shapes);
+BENCHMARK(BM_stage_evaluate_tree)->Apply(shapes);
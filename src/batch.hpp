@@ -0,0 +1,354 @@
+#ifndef _MY_BATCH_
+#define _MY_BATCH_
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <span>
+#include <vector>
+
+#include "kernels.hpp"
+#include "bytecode.hpp"
+#include "thread_pool.hpp"
+
+namespace calc{
+
+    // outcome of a single row of a batch, same rules as the scalar evaluation
+    enum class lane_err : uint8_t{
+        NONE,
+        DIVISION_BY_ZERO,
+        OVERFLOW_UNDERFLOW,
+        UNEXPECTED_VALUE,
+    };
+
+namespace{
+// runs a program over many rows at once: every instruction is applied to a
+// whole block of rows before moving to the next one, so the arithmetic
+// kernels are plain loops over contiguous values the compiler vectorises
+namespace batch{
+
+    static constexpr size_t lanes = 64;
+
+    template<number T>
+    using block = std::array<T, lanes>;
+    using block_err = std::array<lane_err, lanes>;
+
+    constexpr lane_err to_lane_err(calc_err_type_t type){
+        using enum calc_err_type_t;
+
+        switch(type){
+        case DIVISION_BY_ZERO:
+            return lane_err::DIVISION_BY_ZERO;
+        case OVERFLOW_UNDERFLOW:
+            return lane_err::OVERFLOW_UNDERFLOW;
+        default:
+            assert(type == UNEXPECTED_VALUE);
+            return lane_err::UNEXPECTED_VALUE;
+        }
+    }
+
+    // same as !std::isfinite(), written so it vectorises
+    template<std::floating_point T>
+    constexpr bool not_finite(T v){
+        return !(std::fabs(v) <= std::numeric_limits<T>::max());
+    }
+
+    // only the first error of a row is kept, like the scalar evaluation does
+    constexpr lane_err first(lane_err old, bool bad, lane_err e){
+        return old == lane_err::NONE && bad ? e : old;
+    }
+
+    // a op= b, flagging the rows whose result is not finite
+    template<std::floating_point T, typename F>
+    constexpr void arithmetic(block<T>& a, const block<T>& b, block_err& err, size_t n, F op){
+        for(size_t i = 0; i < n; ++i){
+            a[i] = op(a[i], b[i]);
+            err[i] = first(err[i], not_finite(a[i]), lane_err::OVERFLOW_UNDERFLOW);
+        }
+    }
+
+    template<std::floating_point T>
+    constexpr void div(block<T>& a, const block<T>& b, block_err& err, size_t n){
+        for(size_t i = 0; i < n; ++i){
+            const bool zero = std::isless(std::fabs(b[i]), math_utils::epsilon<T>);
+
+            // at run time the division by 0 of a failed row is harmless and
+            // keeps the loop free of branches, constant evaluation rejects it
+            if consteval{
+                a[i] /= zero ? 1 : b[i];
+            }
+            else{
+                a[i] /= b[i];
+            }
+            err[i] = first(
+                err[i], 
+                zero | not_finite(a[i]), 
+                zero ? lane_err::DIVISION_BY_ZERO : lane_err::OVERFLOW_UNDERFLOW
+            );
+        }
+    }
+
+    template<std::floating_point T, typename F>
+    constexpr void unary(block<T>& a, size_t n, F op){
+        for(size_t i = 0; i < n; ++i){
+            a[i] = op(a[i]);
+        }
+    }
+
+    // operators whose cost depends on the value run one row at a time with
+    // the scalar kernel, skipping the rows which already failed
+    template<number T>
+    constexpr void scalar(
+        OPCODE op,
+        block<T>& a,
+        const block<T>* b,
+        block_err& err,
+        size_t n,
+        const token& tok,
+        std::string_view full_expr
+    ){
+        for(size_t i = 0; i < n; ++i){
+            if(err[i] != lane_err::NONE){
+                continue;
+            }
+
+            auto res = b ?
+                kernels::apply(op, a[i], (*b)[i], tok, full_expr) :
+                kernels::apply(op, a[i], tok, full_expr);
+
+            if(res){
+                a[i] = *res;
+            }
+            else{
+                err[i] = to_lane_err(res.error().get_err_type());
+            }
+        }
+    }
+
+    // a = a op b, or a = op a for unary operators. Every integer operator
+    // can overflow, they all run the checked kernels
+    template<number T>
+    constexpr void apply(
+        OPCODE op,
+        block<T>& a,
+        const block<T>& b,
+        block_err& err,
+        size_t n,
+        const token& tok,
+        std::string_view full_expr
+    ){
+        if constexpr(std::integral<T>){
+            scalar(op, a, is_binary(op) ? &b : nullptr, err, n, tok, full_expr);
+        }
+        else{
+            switch(op){
+            case OPCODE::ADD:
+                arithmetic(a, b, err, n, [](T x, T y){ return x + y; });
+                break;
+
+            case OPCODE::SUB:
+                arithmetic(a, b, err, n, [](T x, T y){ return x - y; });
+                break;
+
+            case OPCODE::MULT:
+                arithmetic(a, b, err, n, [](T x, T y){ return x * y; });
+                break;
+
+            case OPCODE::DIV:
+                div(a, b, err, n);
+                break;
+
+            case OPCODE::NEG:
+                unary(a, n, [](T x){ return -x; });
+                break;
+
+            case OPCODE::ABS:
+                unary(a, n, [](T x){ return std::fabs(x); });
+                break;
+
+            case OPCODE::FLOOR:
+                unary(a, n, [](T x){ return std::floor(x); });
+                break;
+
+            case OPCODE::CEIL:
+                unary(a, n, [](T x){ return std::ceil(x); });
+                break;
+
+            default:
+                scalar(op, a, is_binary(op) ? &b : nullptr, err, n, tok, full_expr);
+                break;
+            }
+        }
+    }
+
+    // a missing column would fail on every row
+    template<number T>
+    constexpr std::optional<calc_err> missing_column(
+        const basic_program<T>& p,
+        std::string_view full_expr,
+        size_t columns
+    ){
+        for(size_t pc = 0; pc < p.code.size(); ++pc){
+            if(p.code[pc].op == OPCODE::VAR && p.code[pc].arg >= columns){
+                return kernels::unbound_variable(p.tokens[pc], full_expr).error();
+            }
+        }
+
+        return std::nullopt;
+    }
+
+    // evaluates the rows [first, first + out.size()) of the columns,
+    // scratch holds at least scratch_size() blocks
+    template<number T>
+    constexpr void run_rows(
+        const basic_program<T>& p,
+        std::string_view full_expr,
+        std::span<const std::span<const T>> columns,
+        size_t first,
+        std::span<T> out,
+        std::span<lane_err> errors,
+        std::span<block<T>> scratch
+    ){
+        const auto stack = scratch.first(p.max_stack);
+        const auto regs = scratch.subspan(p.max_stack);
+        const size_t rows = out.size();
+        block_err err{};
+
+        for(size_t base = 0; base < rows; base += lanes){
+            const size_t n = std::min(lanes, rows - base);
+            size_t sp = 0;
+
+            std::fill_n(std::begin(err), n, lane_err::NONE);
+
+            for(size_t pc = 0; pc < p.code.size(); ++pc){
+                const auto [op, arg] = p.code[pc];
+
+                if(op == OPCODE::LIT){
+                    std::fill_n(std::begin(stack[sp++]), n, p.constants[arg]);
+                    continue;
+                }
+
+                if(op == OPCODE::VAR){
+                    std::copy_n(std::begin(columns[arg]) + first + base, n, std::begin(stack[sp++]));
+                    continue;
+                }
+
+                if(op == OPCODE::STORE){
+                    std::copy_n(std::begin(stack[sp - 1]), n, std::begin(regs[arg]));
+                    continue;
+                }
+
+                if(op == OPCODE::LOAD){
+                    std::copy_n(std::begin(regs[arg]), n, std::begin(stack[sp++]));
+                    continue;
+                }
+
+                // operands of binary operators are a and b
+                auto& a = stack[sp - (is_binary(op) ? 2 : 1)];
+                const auto& b = stack[sp - 1];
+
+                apply(op, a, b, err, n, p.tokens[pc], full_expr);
+
+                if(is_binary(op)){
+                    --sp;
+                }
+            }
+
+            assert(sp == 1);
+
+            for(size_t i = 0; i < n; ++i){
+                errors[base + i] = err[i];
+                out[base + i] = err[i] == lane_err::NONE ?
+                    stack[0][i] :
+                    std::numeric_limits<T>::quiet_NaN();
+            }
+        }
+    }
+
+    // columns[slot] holds the value of the variable in that slot for every
+    // row. Rows that fail get NaN (0 for integers) in out and the reason in
+    // errors, the returned error is only for the whole batch
+    template<number T>
+    constexpr std::optional<calc_err> run(
+        const basic_program<T>& p,
+        std::string_view full_expr,
+        std::span<const std::span<const T>> columns,
+        std::span<T> out,
+        std::span<lane_err> errors
+    ){
+        assert(errors.size() == out.size());
+        assert(std::all_of(std::begin(columns), std::end(columns),
+            [&](auto c){ return c.size() >= out.size(); }
+        ));
+
+        auto err = missing_column(p, full_expr, columns.size());
+        if(err){
+            return err;
+        }
+
+        std::vector<block<T>> scratch(p.scratch_size());
+        run_rows<T>(p, full_expr, columns, 0, out, errors, scratch);
+
+        return std::nullopt;
+    }
+
+    // rows per chunk of a parallel run: the values read and written by a
+    // chunk stay in the private caches of the core running it
+    static constexpr size_t chunk_rows = 64 * lanes;
+
+    // same as run(), the chunks are shared among the threads of the pool.
+    // Every thread has its own scratch space and writes disjoint parts of
+    // out and errors
+    template<number T>
+    std::optional<calc_err> run_parallel(
+        const basic_program<T>& p,
+        std::string_view full_expr,
+        std::span<const std::span<const T>> columns,
+        std::span<T> out,
+        std::span<lane_err> errors,
+        thread_pool& pool
+    ){
+        assert(errors.size() == out.size());
+        assert(std::all_of(std::begin(columns), std::end(columns),
+            [&](auto c){ return c.size() >= out.size(); }
+        ));
+
+        auto err = missing_column(p, full_expr, columns.size());
+        if(err){
+            return err;
+        }
+
+        std::vector<std::vector<block<T>>> scratches(pool.size());
+        const size_t rows = out.size();
+        const size_t chunks = (rows + chunk_rows - 1) / chunk_rows;
+
+        pool.parallel_for(chunks, [&](size_t thread, size_t chunk){
+            auto& scratch = scratches[thread];
+            if(scratch.empty()){
+                scratch.resize(p.scratch_size());
+            }
+
+            const size_t first = chunk * chunk_rows;
+            const size_t n = std::min(chunk_rows, rows - first);
+
+            run_rows<T>(
+                p, 
+                full_expr, 
+                columns, 
+                first, 
+                out.subspan(first, n), 
+                errors.subspan(first, n), 
+                scratch
+            );
+        });
+
+        return std::nullopt;
+    }
+}
+}
+}
+
+#endif
@@ -0,0 +1,232 @@
+#ifndef _MY_BYTECODE_
+#define _MY_BYTECODE_
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cmath>
+#include <concepts>
+#include <cstdint>
+#include <limits>
+#include <span>
+#include <vector>
+
+#include "kernels.hpp"
+
+namespace calc{
+namespace{
+
+    struct instruction{
+        OPCODE op;
+        // LIT: index in the constants, VAR: variable slot
+        uint32_t arg;
+    };
+
+    // expression lowered to postfix order: operands are pushed on a value
+    // stack and every operator replaces its operands with the result.
+    // Instructions run in the same order the tree evaluates its nodes, so
+    // the first error found is the same
+    template<number T>
+    struct basic_program{
+        std::vector<instruction> code;
+        // source span of each instruction, only read to build errors
+        std::vector<token> tokens;
+        std::vector<T> constants;
+        size_t max_stack = 0;
+        // values of the shared subexpressions, see OPCODE::STORE
+        size_t registers = 0;
+
+        constexpr void emit(OPCODE op, const token& tok, uint32_t arg = 0){
+            code.emplace_back(op, arg);
+            tokens.push_back(tok);
+
+            if(op == OPCODE::LIT || op == OPCODE::VAR || op == OPCODE::LOAD){
+                ++depth;
+                max_stack = std::max(max_stack, depth);
+            }
+            else if(is_binary(op)){
+                --depth;
+            }
+
+            if(op == OPCODE::STORE || op == OPCODE::LOAD){
+                registers = std::max<size_t>(registers, arg + 1);
+            }
+        }
+
+        // values needed by run(): the stack followed by the registers
+        constexpr size_t scratch_size() const {
+            return max_stack + registers;
+        }
+
+        constexpr void emit_literal(const token& tok, T value){
+            emit(OPCODE::LIT, tok, static_cast<uint32_t>(constants.size()));
+            constants.push_back(value);
+        }
+
+        // at most steps steps, see limits::steps
+        constexpr basic_evaluation_t<T> run(
+            std::string_view full_expr,
+            std::span<const T> vars,
+            size_t steps = SIZE_MAX
+        ) const {
+            // small programs don't allocate
+            std::array<T, 64> small;
+            std::vector<T> big;
+            std::span<T> stack = small;
+
+            if(scratch_size() > small.size()){
+                big.resize(scratch_size());
+                stack = big;
+            }
+
+            // errors are rare: floating point values run without checks
+            // first and only a result which isn't finite runs again with
+            // them, to find the error. Constant evaluation rejects the
+            // infinities, it always checks
+            if constexpr(std::floating_point<T>){
+                if !consteval{
+                    const T ret = run_unchecked(full_expr, vars, stack, steps);
+                    if(std::isfinite(ret)){
+                        return ret;
+                    }
+                }
+            }
+
+            return run(full_expr, vars, stack, steps);
+        }
+
+        // checked at every instruction, scratch must hold at least
+        // scratch_size() values
+        constexpr basic_evaluation_t<T> run(
+            std::string_view full_expr,
+            std::span<const T> vars,
+            std::span<T> scratch,
+            size_t steps = SIZE_MAX
+        ) const {
+            const auto stack = scratch.first(max_stack);
+            const auto regs = scratch.subspan(max_stack);
+            size_t sp = 0;
+            basic_evaluation_t<T> res;
+
+            for(size_t pc = 0; pc < code.size(); ++pc){
+                const auto [op, arg] = code[pc];
+                const auto& tok = tokens[pc];
+
+                switch(op){
+                case OPCODE::LIT:
+                    stack[sp++] = constants[arg];
+                    continue;
+
+                case OPCODE::VAR:
+                    if(arg >= vars.size()){
+                        return kernels::unbound_variable(tok, full_expr);
+                    }
+                    stack[sp++] = vars[arg];
+                    continue;
+
+                case OPCODE::STORE:
+                    regs[arg] = stack[sp - 1];
+                    continue;
+
+                case OPCODE::LOAD:
+                    stack[sp++] = regs[arg];
+                    continue;
+
+                default:
+                {
+                    const auto cost = kernels::steps(op, stack[sp - 1]);
+                    if(cost > steps){
+                        return kernels::step_limit(tok, full_expr);
+                    }
+                    steps -= cost;
+
+                    res = is_binary(op) ?
+                        kernels::apply(op, stack[sp - 2], stack[sp - 1], tok, full_expr) :
+                        kernels::apply(op, stack[sp - 1], tok, full_expr);
+                    break;
+                }
+                }
+
+                if(!res){
+                    return res;
+                }
+
+                // binary operators consume one more operand than they push
+                if(is_binary(op)){
+                    --sp;
+                }
+                stack[sp - 1] = *res;
+            }
+
+            assert(sp == 1);
+
+            return stack[0];
+        }
+
+        // raw arithmetic, see kernels::unchecked(): the result is finite
+        // when run() succeeds, with the same value. Otherwise it is
+        // infinite or NaN, a missing variable and the step limit too
+        constexpr T run_unchecked(
+            std::string_view full_expr,
+            std::span<const T> vars,
+            std::span<T> scratch,
+            size_t steps = SIZE_MAX
+        ) const requires std::floating_point<T> {
+            const auto stack = scratch.first(max_stack);
+            const auto regs = scratch.subspan(max_stack);
+            size_t sp = 0;
+
+            for(size_t pc = 0; pc < code.size(); ++pc){
+                const auto [op, arg] = code[pc];
+
+                switch(op){
+                case OPCODE::LIT:
+                    stack[sp++] = constants[arg];
+                    break;
+
+                case OPCODE::VAR:
+                    stack[sp++] = arg < vars.size() ? vars[arg] : std::numeric_limits<T>::quiet_NaN();
+                    break;
+
+                case OPCODE::STORE:
+                    regs[arg] = stack[sp - 1];
+                    break;
+
+                case OPCODE::LOAD:
+                    stack[sp++] = regs[arg];
+                    break;
+
+                default:
+                {
+                    const auto cost = kernels::steps(op, stack[sp - 1]);
+                    if(cost > steps){
+                        return std::numeric_limits<T>::quiet_NaN();
+                    }
+                    steps -= cost;
+
+                    if(is_binary(op)){
+                        --sp;
+                        stack[sp - 1] = kernels::unchecked(op, stack[sp - 1], stack[sp], tokens[pc], full_expr);
+                    }
+                    else{
+                        stack[sp - 1] = kernels::unchecked(op, stack[sp - 1], tokens[pc], full_expr);
+                    }
+                    break;
+                }
+                }
+            }
+
+            assert(sp == 1);
+
+            return stack[0];
+        }
+
+    private:
+        size_t depth = 0;
+    };
+
+    using program = basic_program<num_t>;
+}
+}
+
+#endif
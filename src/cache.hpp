@@ -0,0 +1,284 @@
+#ifndef _MY_CACHE_
+#define _MY_CACHE_
+
+#include <algorithm>
+#include <cstdint>
+#include <expected>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "lexer.hpp"
+#include "parser.hpp"
+
+namespace calc{
+namespace{
+
+    // the expression without the whitespace the lexer would skip: a space
+    // is only kept where removing it would join two tokens, e.g. "1 2",
+    // "2e +3" or "2e+ 3". Expressions that differ only in spacing have the same tokens.
+    // emit(c, i) is called for each character c kept, i is its offset in str
+    template<typename F>
+    void normalise(std::string_view str, F emit){
+        using CHAR_CLASS = chars::CHAR_CLASS;
+
+        const auto cls = [](char c){
+            return chars::table[static_cast<unsigned char>(c)].cls;
+        };
+        const auto word = [&](char c){
+            const auto k = cls(c);
+            return k == CHAR_CLASS::ALPHA || k == CHAR_CLASS::DIGIT || k == CHAR_CLASS::DOT;
+        };
+
+        const auto exponent = [](char c){
+            return c == 'e' || c == 'E';
+        };
+        const auto sign = [](char c){
+            return c == '+' || c == '-';
+        };
+
+        // the last two characters kept, 0 before the first ones
+        char before = 0;
+        char prev = 0;
+        const auto keep = [&](char c, size_t i){
+            before = prev;
+            prev = c;
+            emit(c, i);
+        };
+
+        for(size_t i = 0; i < str.size();){
+            if(cls(str[i]) != CHAR_CLASS::SPACE){
+                keep(str[i], i);
+                ++i;
+                continue;
+            }
+
+            const size_t space = i;
+            while(i < str.size() && cls(str[i]) == CHAR_CLASS::SPACE){
+                ++i;
+            }
+            if(prev == 0 || i == str.size()){
+                continue;
+            }
+
+            // the sign and the digits of an exponent can't be split either
+            const char next = str[i];
+            const bool joins = (word(prev) && word(next)) ||
+                (exponent(prev) && sign(next)) ||
+                (exponent(before) && sign(prev) && word(next));
+
+            if(joins){
+                keep(' ', space);
+            }
+        }
+    }
+
+    inline std::string normalise(std::string_view str){
+        std::string ret;
+        ret.reserve(str.size());
+
+        normalise(str, [&](char c, size_t){
+            ret += c;
+        });
+
+        return ret;
+    }
+
+    // err, from an entry got for str, with its span in str instead of the
+    // normalised text of the entry
+    inline calc_err locate(const calc_err& err, std::string_view str){
+        if(!err.get_start()){
+            return err;
+        }
+
+        std::vector<size_t> offsets;
+        normalise(str, [&](char, size_t i){
+            offsets.push_back(i);
+        });
+
+        // past the last character is past the end of str
+        const size_t start = *err.get_start();
+        const size_t end = *err.get_end();
+        const size_t from = start < offsets.size() ? offsets[start] : str.size();
+        const size_t to = end > start ? offsets[end - 1] + 1 : from;
+
+        return calc_err::error_with_wrong_token(
+            err.get_err_type(), 
+            err.get_err_msg().data(), 
+            str, 
+            from, 
+            to
+        );
+    }
+
+    // result of an expression kept by a cache
+    template<typename T>
+    struct cached{
+        // normalised, the errors in value refer to it
+        std::string expr;
+        T value;
+
+        template<typename F>
+        cached(std::string&& e, F make):
+            expr(std::move(e)),
+            value(make(std::string_view(expr)))
+        {}
+    };
+
+    // thread-safe least recently used cache of the results of expressions,
+    // keyed on the normalised text. The entries are split in shards by hash,
+    // each with its own lock and its share of the capacity, so threads
+    // looking up different expressions rarely wait on each other. Entries
+    // are shared: one evicted while in use stays valid for its holders
+    template<typename T>
+    class expression_cache{
+
+        using entry = std::shared_ptr<const cached<T>>;
+
+        // the hash is computed once, both for the shard and for its map
+        struct key{
+            size_t hash;
+            std::string_view text;
+
+            bool operator==(const key& other) const {
+                return text == other.text;
+            }
+        };
+
+        struct key_hash{
+            size_t operator()(const key& k) const {
+                return k.hash;
+            }
+        };
+
+        struct shard{
+            std::mutex m;
+            // most recently used first
+            std::list<entry> order;
+            // the key text is the expression of the entry it points to
+            std::unordered_map<key, typename std::list<entry>::iterator, key_hash> index;
+            uint64_t hits = 0;
+            uint64_t misses = 0;
+            uint64_t evictions = 0;
+        };
+
+        std::vector<shard> shards;
+        size_t shard_capacity;
+
+    public:
+        struct counters{
+            uint64_t hits = 0;
+            uint64_t misses = 0;
+            uint64_t evictions = 0;
+        };
+
+        // capacity is the total number of entries, split evenly among the
+        // shards
+        explicit expression_cache(size_t capacity, size_t shard_count = 16):
+            shards(std::max<size_t>(shard_count, 1)),
+            shard_capacity(std::max<size_t>(capacity / shards.size(), 1))
+        {}
+
+        expression_cache(const expression_cache&) = delete;
+        expression_cache& operator=(const expression_cache&) = delete;
+
+        // the cached result of str, computed on a miss. The errors in it
+        // refer to the normalised text, the entry's expr: locate() gives
+        // their span in str. The result is built outside the lock: two
+        // threads missing the same expression at the same time both build
+        // it and the first one is kept
+        entry get(std::string_view str){
+            auto text = normalise(str);
+            const key k{std::hash<std::string_view>{}(text), text};
+            auto& s = shards[k.hash % shards.size()];
+
+            {
+                std::scoped_lock lock(s.m);
+
+                auto it = s.index.find(k);
+                if(it != std::end(s.index)){
+                    ++s.hits;
+                    s.order.splice(std::begin(s.order), s.order, it->second);
+
+                    return *it->second;
+                }
+
+                ++s.misses;
+            }
+
+            auto e = std::make_shared<const cached<T>>(std::move(text), make);
+
+            std::scoped_lock lock(s.m);
+
+            auto [it, inserted] = s.index.try_emplace(key{k.hash, e->expr});
+            if(!inserted){
+                s.order.splice(std::begin(s.order), s.order, it->second);
+
+                return *it->second;
+            }
+
+            s.order.push_front(std::move(e));
+            it->second = std::begin(s.order);
+
+            if(s.order.size() > shard_capacity){
+                const auto& last = s.order.back();
+                s.index.erase(key{std::hash<std::string_view>{}(last->expr), last->expr});
+                s.order.pop_back();
+                ++s.evictions;
+            }
+
+            return *it->second;
+        }
+
+        counters stats(){
+            counters ret;
+
+            for(auto& s : shards){
+                std::scoped_lock lock(s.m);
+                ret.hits += s.hits;
+                ret.misses += s.misses;
+                ret.evictions += s.evictions;
+            }
+
+            return ret;
+        }
+
+        size_t size(){
+            size_t ret = 0;
+
+            for(auto& s : shards){
+                std::scoped_lock lock(s.m);
+                ret += s.order.size();
+            }
+
+            return ret;
+        }
+
+        size_t capacity() const {
+            return shard_capacity * shards.size();
+        }
+
+    private:
+        static T make(std::string_view expr){
+            if constexpr(std::is_same_v<T, evaluation_t>){
+                return parser().evaluate(expr);
+            }
+            else{
+                return parser().compile(expr);
+            }
+        }
+    };
+
+    // final results of expressions without variables
+    using evaluation_cache = expression_cache<evaluation_t>;
+    // compiled expressions, to be evaluated with different values
+    using compilation_cache = expression_cache<std::expected<compiled_expression, calc_err>>;
+}
+}
+
+#endif
@@ -1,9 +1,13 @@
 #ifndef _MY_ERROR_
 #define _MY_ERROR_
 
-#include <string>
+#include <cassert>
+#include <cstdint>
 #include <format>
-#include <cstring>
+#include <limits>
+#include <optional>
+#include <string>
+#include <string_view>
 
 #define RED   "\x1B[1;31m"
 #define GRN   "\x1B[32m"
@@ -14,16 +18,8 @@
 #define WHT   "\x1B[37m"
 #define RESET "\x1B[0m"
 
-static constexpr size_t buf_sz = 127;
-
-static constexpr void my_strncpy(char* dst, const char* src, ssize_t n){
-    while(n-- && *src){
-        *dst++ = *src++;
-    }
-}
-
 namespace calc{
-    enum class calc_err_type_t{
+    enum class calc_err_type_t : uint8_t{
         UNKNOWN_TOKEN,
         EMPTY_EXPRESSION,
         INVALID_LITERAL,
@@ -33,78 +29,103 @@ namespace calc{
         DIVISION_BY_ZERO,
         OVERFLOW_UNDERFLOW,
         UNEXPECTED_VALUE,
+        UNKNOWN_VARIABLE,
+        UNBOUND_VARIABLE,
+        LIMIT_EXCEEDED,
     };
 
+    // a few words: the type, a static message and the span of the error in
+    // the source. The source is not copied, it must outlive the error. The
+    // message is only put together when the error is formatted
     class calc_err{
         
         using enum calc_err_type_t;
+
+        static constexpr uint32_t no_span = std::numeric_limits<uint32_t>::max();
         
+        const char* err_msg;
+        const char* expr;
+        uint32_t expr_size;
+        uint32_t start;
+        uint32_t end;
         calc_err_type_t err_type;
-        std::array<char, buf_sz + 1> err_msg;
-        std::optional<std::array<char, buf_sz + 1>> expr;
-        std::optional<size_t> start;
-        std::optional<size_t> end;
 
     public:
 
         static constexpr calc_err error_message(
             calc_err_type_t type, 
-            std::string_view msg
+            const char* msg
         ){
-            return calc_err(type, msg, std::nullopt, std::nullopt, std::nullopt);
+            return calc_err(type, msg, {}, no_span, no_span);
         }
 
+        // [start, end) is the span of the error in expr
         static constexpr calc_err error_with_wrong_token(
             calc_err_type_t type, 
-            std::string_view msg, 
+            const char* msg, 
             std::string_view expr, 
             size_t start, 
             size_t end
         ){
-            return calc_err(type, msg, expr, start, end);
+            assert(start <= end && end <= expr.size() && expr.size() < no_span);
+
+            return calc_err(
+                type, 
+                msg, 
+                expr, 
+                static_cast<uint32_t>(start), 
+                static_cast<uint32_t>(end)
+            );
         }
 
         constexpr calc_err_type_t get_err_type() const {
             return err_type;
         } 
 
-        constexpr const auto& get_expr() const{
-            return expr;
+        // the source the span refers to
+        constexpr std::optional<std::string_view> get_expr() const{
+            if(start == no_span){
+                return std::nullopt;
+            }
+
+            return std::string_view(expr, expr_size);
         }
         
-        constexpr const auto& get_err_msg() const{
+        constexpr std::string_view get_err_msg() const{
             return err_msg;
         }
 
-        constexpr const auto& get_start() const{
+        constexpr std::optional<size_t> get_start() const{
+            if(start == no_span){
+                return std::nullopt;
+            }
+
             return start;
         }
 
-        constexpr const auto& get_end() const{
+        constexpr std::optional<size_t> get_end() const{
+            if(end == no_span){
+                return std::nullopt;
+            }
+
             return end;
         }
 
     private:
         constexpr calc_err(
             calc_err_type_t type, 
-            std::string_view msg, 
-            std::optional<std::string_view> expr_par, 
-            std::optional<size_t> s, 
-            std::optional<size_t> e
+            const char* msg, 
+            std::string_view expr_par, 
+            uint32_t s, 
+            uint32_t e
         ):
-            err_type(type), 
-            expr(std::nullopt),
+            err_msg(msg),
+            expr(expr_par.data()),
+            expr_size(static_cast<uint32_t>(expr_par.size())),
             start(s), 
-            end(e)
-        {
-            err_msg.fill(0);
-            my_strncpy(err_msg.data(), msg.data(), err_msg.max_size());
-
-            if(expr_par){
-                expr.emplace().fill(0);
-                my_strncpy(expr->data(), expr_par->data(), expr_par->max_size());
-            }
-        }
+            end(e),
+            err_type(type)
+        {}
     };
 }
 
@@ -120,28 +141,29 @@ struct std::formatter<calc::calc_err>{
         return it;
     }
     
-    auto format(calc::calc_err s, auto& ctx) const {
+    // the only place where the message and the underline are built
+    auto format(const calc::calc_err& s, auto& ctx) const {
         if(!s.get_start().has_value()){
             return std::format_to(
                 ctx.out(), 
                 RED "error:" RESET " {}", 
-                s.get_err_msg().data()
+                s.get_err_msg()
             );
         }
 
         // the fields used here must be present according to the class invariant
         // it's safe to dereference them
-        std::string wrong = s.get_expr()->data();
+        const auto wrong = *s.get_expr();
         const auto wrong_part_1 = wrong.substr(0, *s.get_start());
         const auto wrong_part_2 = wrong.substr(*s.get_start(), *s.get_end() - *s.get_start());
-        const auto wrong_part_3 = wrong.substr(*s.get_end(), wrong.length() - *s.get_end());
+        const auto wrong_part_3 = wrong.substr(*s.get_end());
 
         const auto spaces = std::string(*s.get_start(), ' ');
-        const auto underline = std::string(*s.get_end() - *s.get_start() - 1, '~');
+        const auto underline = std::string(std::max<size_t>(*s.get_end() - *s.get_start(), 1) - 1, '~');
         return std::format_to(
             ctx.out(), 
             RED "error:" RESET " {}\n{}" RED "{}" RESET "{}\n{}" RED "^{}" RESET, 
-            s.get_err_msg().data(), 
+            s.get_err_msg(), 
             wrong_part_1,
             wrong_part_2,
             wrong_part_3,
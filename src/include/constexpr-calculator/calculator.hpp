@@ -2,12 +2,139 @@
 #define _MY_CALCULATOR_
 
 #include "parser.hpp"
+#include "static_expression.hpp"
+#include "cache.hpp"
+
+/*
+    the errors returned by these functions don't copy the expression, they
+    point into the caller's string: it must outlive them. A compiled
+    expression owns a copy, the errors of its evaluations refer to that one.
+    The overloads taking a temporary std::string are deleted for this reason
+*/
 
 namespace calc{
+namespace{
+
+    // a std::string about to be destroyed, see above
+    template<typename S>
+    concept temporary_string = std::same_as<S, std::string>;
+}
 
     constexpr evaluation_t evaluate(std::string_view str){
         return parser().evaluate(str);
     }
+
+    template<temporary_string S>
+    evaluation_t evaluate(S&& str) = delete;
+
+    // for untrusted input: going over one of l is a LIMIT_EXCEEDED error
+    constexpr evaluation_t evaluate(std::string_view str, const limits& l){
+        return parser(l).evaluate(str);
+    }
+
+    template<temporary_string S>
+    evaluation_t evaluate(S&& str, const limits& l) = delete;
+
+    // same as evaluate() with values of type T: float, double, long double,
+    // the extended floating point types or int64_t, whose overflows are
+    // checked like the ones of floating point types
+    template<number T>
+    constexpr basic_evaluation_t<T> basic_evaluate(std::string_view str){
+        return basic_parser<T>().evaluate(str);
+    }
+
+    template<number T, temporary_string S>
+    basic_evaluation_t<T> basic_evaluate(S&& str) = delete;
+
+    // parses once, the result can be evaluated many times without re-parsing.
+    // Variables get their slot in order of first appearance
+    constexpr std::expected<compiled_expression, calc_err> compile(std::string_view str){
+        return parser().compile(str);
+    }
+
+    template<temporary_string S>
+    std::expected<compiled_expression, calc_err> compile(S&& str) = delete;
+
+    // the limits on the steps apply to every evaluation of the result
+    constexpr std::expected<compiled_expression, calc_err> compile(std::string_view str, const limits& l){
+        return parser(l).compile(str);
+    }
+
+    template<temporary_string S>
+    std::expected<compiled_expression, calc_err> compile(S&& str, const limits& l) = delete;
+
+    // the slot of each variable is its position in names
+    constexpr std::expected<compiled_expression, calc_err> compile(
+        std::string_view str, 
+        std::span<const std::string_view> names
+    ){
+        return parser().compile(str, names);
+    }
+
+    constexpr std::expected<compiled_expression, calc_err> compile(
+        std::string_view str, 
+        std::initializer_list<std::string_view> names
+    ){
+        return compile(str, std::span(names.begin(), names.size()));
+    }
+
+    template<temporary_string S>
+    std::expected<compiled_expression, calc_err> compile(S&& str, std::span<const std::string_view> names) = delete;
+
+    template<temporary_string S>
+    std::expected<compiled_expression, calc_err> compile(S&& str, std::initializer_list<std::string_view> names) = delete;
+
+    // same as compile() with values of type T, see basic_evaluate(). A
+    // batch of float rows takes half the memory of double ones and twice as
+    // many rows fit in a vector register
+    template<number T>
+    constexpr std::expected<basic_compiled_expression<T>, calc_err> basic_compile(std::string_view str){
+        return basic_parser<T>().compile(str);
+    }
+
+    template<number T, temporary_string S>
+    std::expected<basic_compiled_expression<T>, calc_err> basic_compile(S&& str) = delete;
+
+    template<number T>
+    constexpr std::expected<basic_compiled_expression<T>, calc_err> basic_compile(
+        std::string_view str, 
+        std::initializer_list<std::string_view> names
+    ){
+        return basic_parser<T>().compile(str, std::span(names.begin(), names.size()));
+    }
+
+    template<number T, temporary_string S>
+    std::expected<basic_compiled_expression<T>, calc_err> basic_compile(
+        S&& str, 
+        std::initializer_list<std::string_view> names
+    ) = delete;
+
+    // parsed during compilation: the result is a callable taking one value
+    // per variable, in order of first appearance. An invalid expression is
+    // a compile-time error reporting calc::syntax_error<message, start, end>
+    template<fixed_string str>
+    consteval auto compile(){
+        using expr_t = static_expression<str>;
+
+        constexpr auto err = expr_t::error();
+        if constexpr(err.has_value()){
+            constexpr auto msg = []{
+                constexpr auto text = expr_t::error()->get_err_msg();
+                std::array<char, text.size() + 1> ret{};
+                std::ranges::copy(text, std::begin(ret));
+
+                return ret;
+            }();
+
+            [[maybe_unused]] syntax_error<
+                fixed_string(msg),
+                err->get_start().value_or(0),
+                err->get_end().value_or(0)
+            > diagnostic;
+        }
+
+        return expr_t{};
+    }
 }
 
 #endif
\ No newline at end of file
@@ -0,0 +1,11 @@
+#ifndef _MY_CALCULATOR_JIT_
+#define _MY_CALCULATOR_JIT_
+
+// optional, not part of calculator.hpp: the translation of compiled
+// expressions to machine code, see calc::jit_expression. It maps memory
+// with the POSIX calls on Linux x86-64
+
+#include "calculator.hpp"
+#include "jit.hpp"
+
+#endif
@@ -0,0 +1,380 @@
+#ifndef _MY_JIT_
+#define _MY_JIT_
+
+#include <array>
+#include <bit>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <limits>
+#include <span>
+#include <utility>
+#include <vector>
+
+#if defined(__linux__) && defined(__x86_64__)
+#include <sys/mman.h>
+#define CALC_JIT_NATIVE 1
+#else
+#define CALC_JIT_NATIVE 0
+#endif
+
+#include "parser.hpp"
+
+namespace calc{
+namespace{
+// translates the bytecode of a compiled expression to x86-64 machine code,
+// at run time only. The value stack lives in the frame of the generated
+// function, its top in xmm0: every operator is a few SSE2 instructions and
+// the ones whose cost depends on the value call the kernels. The semantics
+// are the ones of basic_program::run_unchecked()
+namespace jit{
+
+    using function_t = double(*)(const double* vars);
+
+    // called by the generated code, with the values in xmm0 and xmm1
+    inline double power(double b, double e){
+        return kernels::unchecked(OPCODE::EXPONENT, b, e, token{}, {});
+    }
+
+    inline double factorial(double n){
+        return kernels::unchecked(OPCODE::FACTORIAL, n, token{}, {});
+    }
+
+    inline double floor(double n){
+        return std::floor(n);
+    }
+
+    inline double ceil(double n){
+        return std::ceil(n);
+    }
+
+    // the few encodings the lowering needs, xmm registers 0 to 7 only
+    class assembler{
+
+        std::vector<uint8_t> buf;
+
+        void bytes(std::initializer_list<uint8_t> b){
+            buf.insert(std::end(buf), b);
+        }
+
+        template<typename V>
+        void value(V v){
+            const auto b = std::bit_cast<std::array<uint8_t, sizeof(V)>>(v);
+            buf.insert(std::end(buf), std::begin(b), std::end(b));
+        }
+
+        // reg, rm are both registers
+        static constexpr uint8_t direct(uint8_t reg, uint8_t rm){
+            return static_cast<uint8_t>(0xC0 | reg << 3 | rm);
+        }
+
+    public:
+        std::span<const uint8_t> code() const {
+            return buf;
+        }
+
+        // push rbx; mov rbx, rdi; sub rsp, frame
+        void prologue(uint32_t frame){
+            bytes({0x53, 0x48, 0x89, 0xFB, 0x48, 0x81, 0xEC});
+            value(frame);
+        }
+
+        // add rsp, frame; pop rbx; ret
+        void epilogue(uint32_t frame){
+            bytes({0x48, 0x81, 0xC4});
+            value(frame);
+            bytes({0x5B, 0xC3});
+        }
+
+        // movsd xmm, [rsp + offset]
+        void load_frame(uint8_t xmm, uint32_t offset){
+            bytes({0xF2, 0x0F, 0x10, static_cast<uint8_t>(0x84 | xmm << 3), 0x24});
+            value(offset);
+        }
+
+        // movsd [rsp + offset], xmm
+        void store_frame(uint32_t offset, uint8_t xmm){
+            bytes({0xF2, 0x0F, 0x11, static_cast<uint8_t>(0x84 | xmm << 3), 0x24});
+            value(offset);
+        }
+
+        // movsd xmm, [rbx + offset], rbx points to the variables
+        void load_var(uint8_t xmm, uint32_t offset){
+            bytes({0xF2, 0x0F, 0x10, static_cast<uint8_t>(0x83 | xmm << 3)});
+            value(offset);
+        }
+
+        // mov rax, bits; movq xmm, rax
+        void constant(uint8_t xmm, double v){
+            bytes({0x48, 0xB8});
+            value(v);
+            bytes({0x66, 0x48, 0x0F, 0x6E, direct(xmm, 0)});
+        }
+
+        // the scalar double instructions: 0x58 add, 0x5C sub, 0x59 mul,
+        // 0x5E div
+        void scalar(uint8_t opcode, uint8_t dst, uint8_t src){
+            bytes({0xF2, 0x0F, opcode, direct(dst, src)});
+        }
+
+        // the packed double ones: 0x28 movapd, 0x54 andpd, 0x56 orpd,
+        // 0x57 xorpd
+        void packed(uint8_t opcode, uint8_t dst, uint8_t src){
+            bytes({0x66, 0x0F, opcode, direct(dst, src)});
+        }
+
+        // cmpsd dst, src, predicate: all ones when it holds
+        void compare(uint8_t dst, uint8_t src, uint8_t predicate){
+            bytes({0xF2, 0x0F, 0xC2, direct(dst, src), predicate});
+        }
+
+        // roundsd xmm, xmm, mode, SSE4.1
+        void round(uint8_t xmm, uint8_t mode){
+            bytes({0x66, 0x0F, 0x3A, 0x0B, direct(xmm, xmm), mode});
+        }
+
+        // mov rax, f; call rax
+        template<typename F>
+        void call(F* f){
+            bytes({0x48, 0xB8});
+            value(reinterpret_cast<uint64_t>(f));
+            bytes({0xFF, 0xD0});
+        }
+    };
+
+    constexpr uint8_t ADDSD = 0x58;
+    constexpr uint8_t SUBSD = 0x5C;
+    constexpr uint8_t MULSD = 0x59;
+    constexpr uint8_t DIVSD = 0x5E;
+    constexpr uint8_t MOVAPD = 0x28;
+    constexpr uint8_t ANDPD = 0x54;
+    constexpr uint8_t ORPD = 0x56;
+    constexpr uint8_t XORPD = 0x57;
+    constexpr uint8_t CMPLT = 1;
+    constexpr uint8_t CMPNLE = 6;
+    constexpr uint8_t ROUND_FLOOR = 0x9;
+    constexpr uint8_t ROUND_CEIL = 0xA;
+
+    constexpr double sign_bit = std::bit_cast<double>(uint64_t{1} << 63);
+    constexpr double no_sign = std::bit_cast<double>(~(uint64_t{1} << 63));
+
+    // the whole function for p. Value i of the stack is at [rsp + 8 i],
+    // the top one is only in xmm0, the registers follow the stack
+    inline assembler lower(const program& p, bool sse41){
+        assembler a;
+
+        // rsp is 8 past a multiple of 16 on entry, the push of rbx aligns
+        // it and the frame keeps it aligned for the calls
+        const auto frame = static_cast<uint32_t>((p.scratch_size() * sizeof(double) + 15) / 16 * 16);
+        const auto slot = [](size_t i){
+            return static_cast<uint32_t>(i * sizeof(double));
+        };
+
+        a.prologue(frame);
+
+        size_t sp = 0;
+        // the top of the stack goes to memory when a value is pushed over it
+        const auto push = [&]{
+            if(sp > 0){
+                a.store_frame(slot(sp - 1), 0);
+            }
+            ++sp;
+        };
+
+        for(const auto [op, arg] : p.code){
+            switch(op){
+            case OPCODE::LIT:
+                push();
+                a.constant(0, p.constants[arg]);
+                break;
+
+            case OPCODE::VAR:
+                push();
+                a.load_var(0, slot(arg));
+                break;
+
+            case OPCODE::STORE:
+                a.store_frame(slot(p.max_stack + arg), 0);
+                break;
+
+            case OPCODE::LOAD:
+                push();
+                a.load_frame(0, slot(p.max_stack + arg));
+                break;
+
+            case OPCODE::NEG:
+                a.constant(1, sign_bit);
+                a.packed(XORPD, 0, 1);
+                break;
+
+            case OPCODE::ABS:
+                a.constant(1, no_sign);
+                a.packed(ANDPD, 0, 1);
+                break;
+
+            case OPCODE::FACTORIAL:
+                a.call(&jit::factorial);
+                break;
+
+            case OPCODE::FLOOR:
+                if(sse41){
+                    a.round(0, ROUND_FLOOR);
+                }
+                else{
+                    a.call(&jit::floor);
+                }
+                break;
+
+            case OPCODE::CEIL:
+                if(sse41){
+                    a.round(0, ROUND_CEIL);
+                }
+                else{
+                    a.call(&jit::ceil);
+                }
+                break;
+
+            default:
+                // binary: the left operand to xmm0, the right one to xmm1
+                --sp;
+                a.packed(MOVAPD, 1, 0);
+                a.load_frame(0, slot(sp - 1));
+
+                switch(op){
+                case OPCODE::ADD:
+                    a.scalar(ADDSD, 0, 1);
+                    break;
+                case OPCODE::SUB:
+                    a.scalar(SUBSD, 0, 1);
+                    break;
+                case OPCODE::MULT:
+                    a.scalar(MULSD, 0, 1);
+                    break;
+                case OPCODE::DIV:
+                    // all ones, a NaN, where the divisor fails like in
+                    // kernels::div(): |d| < epsilon or not finite
+                    a.packed(MOVAPD, 2, 1);
+                    a.constant(3, no_sign);
+                    a.packed(ANDPD, 2, 3);
+                    a.packed(MOVAPD, 3, 2);
+                    a.constant(4, math_utils::epsilon<double>);
+                    a.compare(3, 4, CMPLT);
+                    a.constant(4, std::numeric_limits<double>::max());
+                    a.compare(2, 4, CMPNLE);
+                    a.packed(ORPD, 2, 3);
+                    a.scalar(DIVSD, 0, 1);
+                    a.packed(ORPD, 0, 2);
+                    break;
+                default:
+                    assert(op == OPCODE::EXPONENT);
+                    a.call(&jit::power);
+                    break;
+                }
+                break;
+            }
+        }
+
+        assert(sp == 1);
+
+        a.epilogue(frame);
+
+        return a;
+    }
+}
+
+    // a compiled expression with its bytecode translated to native code,
+    // on Linux x86-64. Elsewhere, or when the code can't be mapped, it
+    // runs the bytecode instead: see native(). The compiled expression must
+    // outlive it and stay where it is
+    class jit_expression{
+
+        const compiled_expression* source;
+        void* mapping = nullptr;
+        size_t mapping_size = 0;
+
+    public:
+        explicit jit_expression(const compiled_expression& c):
+            source(&c)
+        {
+#if CALC_JIT_NATIVE
+            // the native code doesn't count the steps
+            if(c.step_limit() != SIZE_MAX){
+                return;
+            }
+
+            const auto a = jit::lower(c.bytecode(), __builtin_cpu_supports("sse4.1"));
+            const auto code = a.code();
+
+            void* m = ::mmap(nullptr, code.size(), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if(m == MAP_FAILED){
+                return;
+            }
+
+            std::memcpy(m, code.data(), code.size());
+
+            // never writable and executable at the same time
+            if(::mprotect(m, code.size(), PROT_READ | PROT_EXEC) != 0){
+                ::munmap(m, code.size());
+                return;
+            }
+
+            mapping = m;
+            mapping_size = code.size();
+#endif
+        }
+
+        jit_expression(jit_expression&& other) noexcept:
+            source(other.source),
+            mapping(std::exchange(other.mapping, nullptr)),
+            mapping_size(std::exchange(other.mapping_size, 0))
+        {}
+
+        jit_expression& operator=(jit_expression&& other) noexcept {
+            std::swap(source, other.source);
+            std::swap(mapping, other.mapping);
+            std::swap(mapping_size, other.mapping_size);
+
+            return *this;
+        }
+
+        ~jit_expression(){
+#if CALC_JIT_NATIVE
+            if(mapping){
+                ::munmap(mapping, mapping_size);
+            }
+#endif
+        }
+
+        bool native() const {
+            return mapping != nullptr;
+        }
+
+        // nullptr without native code. vars holds a value per variable, in
+        // slot order. Like the checks of math_utils::safe_*, the result
+        // isn't finite when the evaluation fails: evaluate() tells the error
+        jit::function_t function() const {
+            return reinterpret_cast<jit::function_t>(mapping);
+        }
+
+        // same result and errors as compiled_expression::evaluate()
+        evaluation_t evaluate(std::span<const num_t> values = {}) const {
+            if(native() && values.size() >= source->variables().size()){
+                const auto ret = function()(values.data());
+                if(std::isfinite(ret)){
+                    return ret;
+                }
+            }
+
+            return source->evaluate(values);
+        }
+
+        evaluation_t evaluate(std::initializer_list<num_t> values) const {
+            return evaluate(std::span(values.begin(), values.size()));
+        }
+    };
+}
+}
+
+#endif
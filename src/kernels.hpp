@@ -0,0 +1,411 @@
+#ifndef _MY_KERNELS_
+#define _MY_KERNELS_
+
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <expected>
+#include <limits>
+#include <string_view>
+
+#include "tokenizer.hpp"
+#include "math_utils.hpp"
+
+namespace calc{
+    template<number T>
+    using basic_evaluation_t = std::expected<T, calc_err>;
+
+    using evaluation_t = basic_evaluation_t<num_t>;
+
+namespace{
+
+    using token = tokenizer::token;
+
+    // every node kind, also used as instruction set by the bytecode
+    enum class OPCODE : uint8_t{
+        LIT,
+        VAR,
+        ADD,
+        SUB,
+        MULT,
+        DIV,
+        EXPONENT,
+        NEG,
+        FACTORIAL,
+        ABS,
+        FLOOR,
+        CEIL,
+        // bytecode only: STORE copies the top of the stack to register arg,
+        // LOAD pushes it. Shared subexpressions are computed once
+        STORE,
+        LOAD,
+    };
+
+    constexpr bool is_binary(OPCODE op){
+        return op == OPCODE::ADD || op == OPCODE::SUB || op == OPCODE::MULT || 
+            op == OPCODE::DIV || op == OPCODE::EXPONENT;
+    }
+
+// checked implementation of every operator, shared by all the evaluators.
+// full_expr and tok are only read to build the error
+namespace kernels{
+
+    constexpr std::unexpected<calc_err> overflow(const token& tok, std::string_view full_expr){
+        return std::unexpected(
+            calc_err::error_with_wrong_token(
+                calc_err_type_t::OVERFLOW_UNDERFLOW,
+                "overflow/underflow detected",
+                full_expr,
+                tok.start,
+                tok.end
+            )
+        );
+    }
+
+    constexpr std::unexpected<calc_err> division_by_zero(const token& tok, std::string_view full_expr){
+        return std::unexpected(
+            calc_err::error_with_wrong_token(
+                calc_err_type_t::DIVISION_BY_ZERO,
+                "Division by 0 detected",
+                full_expr,
+                tok.start,
+                tok.end
+            )
+        );
+    }
+
+    template<number T>
+    constexpr basic_evaluation_t<T> add(T a, T b, const token& tok, std::string_view full_expr){
+        auto ret = math_utils::safe_add(a, b);
+        if(ret){
+            return *ret;
+        }
+
+        return overflow(tok, full_expr);
+    }
+
+    template<number T>
+    constexpr basic_evaluation_t<T> sub(T a, T b, const token& tok, std::string_view full_expr){
+        auto ret = math_utils::safe_sub(a, b);
+        if(ret){
+            return *ret;
+        }
+
+        return overflow(tok, full_expr);
+    }
+
+    template<number T>
+    constexpr basic_evaluation_t<T> mult(T a, T b, const token& tok, std::string_view full_expr){
+        auto ret = math_utils::safe_mult(a, b);
+        if(ret){
+            return *ret;
+        }
+
+        return overflow(tok, full_expr);
+    }
+
+    template<number T>
+    constexpr basic_evaluation_t<T> div(T n, T d, const token& tok, std::string_view full_expr){
+        if(math_utils::is_zero(d)){
+            return division_by_zero(tok, full_expr);
+        }
+
+        auto ret = math_utils::safe_div(n, d);
+        if(ret){
+            return *ret;
+        }
+
+        return overflow(tok, full_expr);
+    }
+
+    template<number T>
+    constexpr basic_evaluation_t<T> exponent(T b, T e, const token& tok, std::string_view full_expr){
+        // auto ret = std::pow(b, e); constexpr since c++26
+        if(!math_utils::is_integer(e)){
+            return std::unexpected(
+                calc_err::error_with_wrong_token(
+                    calc_err_type_t::UNEXPECTED_VALUE,
+                    "Exponent must be an integer",
+                    full_expr,
+                    tok.start,
+                    tok.end
+                )
+            );
+        }
+
+        e = math_utils::remove_decimal_part(e);
+
+        if(!std::isless(e, T{0})){
+            auto ret = math_utils::pow(b, e);
+            if(ret){
+                return *ret;
+            }
+
+            return overflow(tok, full_expr);
+        }
+
+        // b^-e is 1 / b^e, with the same rule on the divisor as div
+        if(math_utils::is_zero(b)){
+            return division_by_zero(tok, full_expr);
+        }
+
+        if constexpr(std::integral<T>){
+            // truncated like a division: only 1 and -1 don't give 0, and
+            // -e may not fit
+            if(b == 1 || b == -1){
+                return e % 2 == 0 ? T{1} : b;
+            }
+
+            return T{0};
+        }
+        else{
+            auto den = math_utils::pow(b, static_cast<T>(-e));
+            if(!den){
+                // |b|^e doesn't fit, (1/b)^e doesn't overflow as |1/b| < 1
+                return *math_utils::pow(static_cast<T>(1 / b), static_cast<T>(-e));
+            }
+
+            auto ret = math_utils::safe_div(static_cast<T>(1), *den);
+            if(ret){
+                return *ret;
+            }
+
+            return overflow(tok, full_expr);
+        }
+    }
+
+    template<number T>
+    constexpr basic_evaluation_t<T> neg(T n, const token& tok, std::string_view full_expr){
+        auto ret = math_utils::safe_neg(n);
+        if(ret){
+            return *ret;
+        }
+
+        return overflow(tok, full_expr);
+    }
+
+    template<number T>
+    constexpr basic_evaluation_t<T> factorial(T n, const token& tok, std::string_view full_expr){
+        if(std::isless(n, T{0})){
+            return std::unexpected(
+                calc_err::error_with_wrong_token(
+                    calc_err_type_t::UNEXPECTED_VALUE,
+                    "Factorial can't be applied to a negative value",
+                    full_expr,
+                    tok.start,
+                    tok.end
+                )
+            );
+        }
+
+        auto ret = math_utils::factorial(math_utils::remove_decimal_part(n));
+        if(ret){
+            return *ret;
+        }
+
+        return std::unexpected(
+            calc_err::error_with_wrong_token(
+                calc_err_type_t::OVERFLOW_UNDERFLOW,
+                "overflow detected",
+                full_expr,
+                tok.start,
+                tok.end
+            )
+        );
+    }
+
+    template<number T>
+    constexpr basic_evaluation_t<T> abs(T n, const token& tok, std::string_view full_expr){
+        auto ret = math_utils::safe_abs(n);
+        if(ret){
+            return *ret;
+        }
+
+        return overflow(tok, full_expr);
+    }
+
+    template<number T>
+    constexpr basic_evaluation_t<T> floor(T n, [[maybe_unused]] const token& tok, [[maybe_unused]] std::string_view full_expr){
+        if constexpr(std::integral<T>){
+            return n;
+        }
+        else{
+            return std::floor(n);
+        }
+    }
+
+    template<number T>
+    constexpr basic_evaluation_t<T> ceil(T n, [[maybe_unused]] const token& tok, [[maybe_unused]] std::string_view full_expr){
+        if constexpr(std::integral<T>){
+            return n;
+        }
+        else{
+            return std::ceil(n);
+        }
+    }
+
+    // binary operators
+    template<number T>
+    constexpr basic_evaluation_t<T> apply(OPCODE op, T a, T b, const token& tok, std::string_view full_expr){
+        switch(op){
+        case OPCODE::ADD:
+            return add(a, b, tok, full_expr);
+        case OPCODE::SUB:
+            return sub(a, b, tok, full_expr);
+        case OPCODE::MULT:
+            return mult(a, b, tok, full_expr);
+        case OPCODE::DIV:
+            return div(a, b, tok, full_expr);
+        default:
+            assert(op == OPCODE::EXPONENT);
+            return exponent(a, b, tok, full_expr);
+        }
+    }
+
+    // unary operators
+    template<number T>
+    constexpr basic_evaluation_t<T> apply(OPCODE op, T n, const token& tok, std::string_view full_expr){
+        switch(op){
+        case OPCODE::NEG:
+            return neg(n, tok, full_expr);
+        case OPCODE::FACTORIAL:
+            return factorial(n, tok, full_expr);
+        case OPCODE::ABS:
+            return abs(n, tok, full_expr);
+        case OPCODE::FLOOR:
+            return floor(n, tok, full_expr);
+        default:
+            assert(op == OPCODE::CEIL);
+            return ceil(n, tok, full_expr);
+        }
+    }
+
+    // floating point operators without the checks: a failure is NaN and an
+    // overflow an infinity, which the next operators carry to the result.
+    // The operators which could turn them back into a finite value give NaN
+    // instead, e.g. a division by infinity. The result is finite only when
+    // the checked kernels would succeed, with the same value. Powers and
+    // factorials depend on the value, they run the checked kernels
+
+    template<std::floating_point T>
+    constexpr T unchecked(OPCODE op, T a, T b, const token& tok, std::string_view full_expr){
+        constexpr T nan = std::numeric_limits<T>::quiet_NaN();
+
+        switch(op){
+        case OPCODE::ADD:
+            return a + b;
+        case OPCODE::SUB:
+            return a - b;
+        case OPCODE::MULT:
+            return a * b;
+        case OPCODE::DIV:
+            // the same divisors as div() fail
+            return std::isless(std::fabs(b), math_utils::epsilon<T>) || !std::isfinite(b) ?
+                nan : 
+                a / b;
+        default:
+            assert(op == OPCODE::EXPONENT);
+            if(!std::isfinite(a) || !std::isfinite(b)){
+                return nan;
+            }
+
+            return exponent(a, b, tok, full_expr).value_or(nan);
+        }
+    }
+
+    template<std::floating_point T>
+    constexpr T unchecked(OPCODE op, T n, const token& tok, std::string_view full_expr){
+        switch(op){
+        case OPCODE::NEG:
+            return -n;
+        case OPCODE::FACTORIAL:
+            if(!std::isfinite(n)){
+                return std::numeric_limits<T>::quiet_NaN();
+            }
+
+            return factorial(n, tok, full_expr).value_or(std::numeric_limits<T>::quiet_NaN());
+        case OPCODE::ABS:
+            return std::fabs(n);
+        case OPCODE::FLOOR:
+            return std::floor(n);
+        default:
+            assert(op == OPCODE::CEIL);
+            return std::ceil(n);
+        }
+    }
+
+    // the operator applied to integers when the result is an integer which
+    // fits, the checks are the overflow flags. nullopt otherwise, also when
+    // the floating point kernel would fail: that one then runs and reports
+    // the error. b is ignored by unary operators
+    constexpr std::optional<int64_t> exact(OPCODE op, int64_t a, int64_t b = 0){
+        switch(op){
+        case OPCODE::ADD:
+            return math_utils::safe_add(a, b);
+        case OPCODE::SUB:
+            return math_utils::safe_sub(a, b);
+        case OPCODE::MULT:
+            return math_utils::safe_mult(a, b);
+        case OPCODE::DIV:
+            if(b == 0 || b == -1){
+                return b == 0 ? std::nullopt : math_utils::safe_neg(a);
+            }
+            if(a % b != 0){
+                return std::nullopt;
+            }
+            return a / b;
+        case OPCODE::EXPONENT:
+            if(b < 0){
+                return std::nullopt;
+            }
+            return math_utils::pow(a, b);
+        case OPCODE::NEG:
+            return math_utils::safe_neg(a);
+        case OPCODE::FACTORIAL:
+            if(a < 0){
+                return std::nullopt;
+            }
+            return math_utils::factorial(a);
+        case OPCODE::ABS:
+            return math_utils::safe_abs(a);
+        default:
+            assert(op == OPCODE::FLOOR || op == OPCODE::CEIL);
+            return a;
+        }
+    }
+
+    constexpr std::unexpected<calc_err> step_limit(const token& tok, std::string_view full_expr){
+        return std::unexpected(
+            calc_err::error_with_wrong_token(
+                calc_err_type_t::LIMIT_EXCEEDED,
+                "Too many steps, limit exceeded",
+                full_expr,
+                tok.start,
+                tok.end
+            )
+        );
+    }
+
+    // steps taken by op, see limits::steps. n is the right operand of a
+    // binary operator, the only one of a unary one
+    template<number T>
+    constexpr size_t steps(OPCODE op, T n){
+        return op == OPCODE::EXPONENT ? 1 + math_utils::pow_steps(n) : 1;
+    }
+
+    constexpr std::unexpected<calc_err> unbound_variable(const token& tok, std::string_view full_expr){
+        return std::unexpected(
+            calc_err::error_with_wrong_token(
+                calc_err_type_t::UNBOUND_VARIABLE,
+                "No value provided for variable",
+                full_expr,
+                tok.start,
+                tok.end
+            )
+        );
+    }
+}
+}
+}
+
+#endif
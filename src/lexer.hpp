@@ -0,0 +1,331 @@
+#ifndef _MY_LEXER_
+#define _MY_LEXER_
+
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+
+#include "ctre/single-header/ctre.hpp"
+
+#define regex "(?<lit>([0-9]*[.])?[0-9]+([eE][+-]?[0-9]+)?)|"\
+              "(?<open_par>\\()|"\
+              "(?<closed_par>\\))|"\
+              "(?<plus>\\+)|"\
+              "(?<minus>-)|"\
+              "(?<exponent>\\^)|"\
+              "(?<asterisk>\\*)|"\
+              "(?<slash>\\/)|"\
+              "(?<factorial>!)|"\
+              "(?<ident>[a-zA-Z_][a-zA-Z0-9_]*)|"\
+              "(?<space>\\s+)|.+"
+
+namespace calc{
+namespace{
+
+    struct token_defs{
+        enum class TOKEN_TYPE{
+            LIT,
+            OPEN_PAR,
+            CLOSED_PAR,
+            PLUS,
+            MINUS,
+            ASTERISK,
+            SLASH,
+            FACTORIAL,
+            EXPONENT,
+            ABS,
+            FLOOR,
+            CEIL,
+            VAR,
+
+        };
+
+        struct token{
+            TOKEN_TYPE type;
+            // offsets of the token inside the expression buffer, which is
+            // owned by the parser and never copied per token
+            size_t start;
+            size_t end;
+
+            constexpr std::string_view text(std::string_view full_expr) const {
+                return full_expr.substr(start, end - start);
+            }
+        };
+
+        // what a lexer backend found at the beginning of the input
+        struct lexeme{
+            enum class KIND{
+                TOKEN,
+                SPACE,
+                UNKNOWN,
+            };
+
+            KIND kind;
+            TOKEN_TYPE type;
+            size_t size;
+        };
+    };
+
+namespace keywords{
+    using TOKEN_TYPE = token_defs::TOKEN_TYPE;
+
+    struct keyword{
+        std::string_view name;
+        TOKEN_TYPE type;
+    };
+
+    // every function name of the grammar: adding one here is enough for both
+    // lexer backends. Any other identifier is a variable
+    static constexpr std::array list{
+        keyword{"abs", TOKEN_TYPE::ABS},
+        keyword{"floor", TOKEN_TYPE::FLOOR},
+        keyword{"ceil", TOKEN_TYPE::CEIL},
+    };
+
+    static constexpr size_t table_sz = std::bit_ceil(list.size() * 2);
+
+    constexpr size_t hash(std::string_view s, size_t seed){
+        const auto first = static_cast<unsigned char>(s.front());
+        const auto last = static_cast<unsigned char>(s.back());
+
+        return ((first * seed) ^ (last + s.size())) & (table_sz - 1);
+    }
+
+    // smallest seed for which the hash has no collisions on the keyword list
+    static constexpr size_t seed = []{
+        for(size_t s = 1;; ++s){
+            std::array<bool, table_sz> used{};
+            bool ok = true;
+
+            for(const auto& k : list){
+                auto& slot = used[hash(k.name, s)];
+                ok = ok && !slot;
+                slot = true;
+            }
+
+            if(ok){
+                return s;
+            }
+        }
+    }();
+
+    static constexpr auto table = []{
+        std::array<std::optional<keyword>, table_sz> ret{};
+
+        for(const auto& k : list){
+            ret[hash(k.name, seed)] = k;
+        }
+
+        return ret;
+    }();
+
+    // perfect hash lookup: one probe and one comparison
+    constexpr std::optional<TOKEN_TYPE> find(std::string_view s){
+        const auto& slot = table[hash(s, seed)];
+        if(slot && slot->name == s){
+            return slot->type;
+        }
+
+        return std::nullopt;
+    }
+}
+
+    // lexer backend based on the CTRE regex above
+    struct ctre_lexer : token_defs{
+
+        static constexpr lexeme scan(std::string_view input){
+            using enum lexeme::KIND;
+
+            auto r = ctre::starts_with<regex>(input);
+            const size_t sz = r.to_view().size();
+
+            //println("Token '{}'", r.str());
+
+            if(r.get<"lit">()){
+                return {TOKEN, TOKEN_TYPE::LIT, sz};
+            }
+            else if(r.get<"open_par">()){
+                return {TOKEN, TOKEN_TYPE::OPEN_PAR, sz};
+            }
+            else if(r.get<"closed_par">()){
+                return {TOKEN, TOKEN_TYPE::CLOSED_PAR, sz};
+            }
+            else if(r.get<"plus">()){
+                return {TOKEN, TOKEN_TYPE::PLUS, sz};
+            }
+            else if(r.get<"minus">()){
+                return {TOKEN, TOKEN_TYPE::MINUS, sz};
+            }
+            else if(r.get<"asterisk">()){
+                return {TOKEN, TOKEN_TYPE::ASTERISK, sz};
+            }
+            else if(r.get<"slash">()){
+                return {TOKEN, TOKEN_TYPE::SLASH, sz};
+            }
+            else if(r.get<"factorial">()){
+                return {TOKEN, TOKEN_TYPE::FACTORIAL, sz};
+            }
+            else if(r.get<"exponent">()){
+                return {TOKEN, TOKEN_TYPE::EXPONENT, sz};
+            }
+            else if(r.get<"ident">()){
+                auto kw = keywords::find(r.to_view());
+
+                return {TOKEN, kw.value_or(TOKEN_TYPE::VAR), sz};
+            }
+            else if(r.get<"space">()){
+                return {SPACE, {}, sz};
+            }
+
+            // the catch-all alternative swallows the rest of the input
+            return {UNKNOWN, {}, input.size()};
+        }
+    };
+
+namespace chars{
+    using TOKEN_TYPE = token_defs::TOKEN_TYPE;
+
+    enum class CHAR_CLASS : uint8_t{
+        OTHER,
+        DIGIT,
+        DOT,
+        ALPHA,
+        SPACE,
+        OPERATOR,
+    };
+
+    struct char_info{
+        CHAR_CLASS cls = CHAR_CLASS::OTHER;
+        TOKEN_TYPE type = {};
+    };
+
+    static constexpr auto table = []{
+        std::array<char_info, 256> ret{};
+
+        for(unsigned char c = '0'; c <= '9'; ++c){
+            ret[c].cls = CHAR_CLASS::DIGIT;
+        }
+        for(unsigned char c = 'a'; c <= 'z'; ++c){
+            ret[c].cls = CHAR_CLASS::ALPHA;
+            ret[c - 'a' + 'A'].cls = CHAR_CLASS::ALPHA;
+        }
+        ret['_'].cls = CHAR_CLASS::ALPHA;
+        ret['.'].cls = CHAR_CLASS::DOT;
+
+        for(char c : {' ', '\t', '\n', '\v', '\f', '\r'}){
+            ret[static_cast<unsigned char>(c)].cls = CHAR_CLASS::SPACE;
+        }
+
+        ret['('] = {CHAR_CLASS::OPERATOR, TOKEN_TYPE::OPEN_PAR};
+        ret[')'] = {CHAR_CLASS::OPERATOR, TOKEN_TYPE::CLOSED_PAR};
+        ret['+'] = {CHAR_CLASS::OPERATOR, TOKEN_TYPE::PLUS};
+        ret['-'] = {CHAR_CLASS::OPERATOR, TOKEN_TYPE::MINUS};
+        ret['^'] = {CHAR_CLASS::OPERATOR, TOKEN_TYPE::EXPONENT};
+        ret['*'] = {CHAR_CLASS::OPERATOR, TOKEN_TYPE::ASTERISK};
+        ret['/'] = {CHAR_CLASS::OPERATOR, TOKEN_TYPE::SLASH};
+        ret['!'] = {CHAR_CLASS::OPERATOR, TOKEN_TYPE::FACTORIAL};
+
+        return ret;
+    }();
+}
+
+    // single pass lexer backend: characters are classified with a table and
+    // identifiers are looked up in the keyword perfect hash
+    struct table_lexer : token_defs{
+        using CHAR_CLASS = chars::CHAR_CLASS;
+
+        static constexpr const chars::char_info& info(char c){
+            return chars::table[static_cast<unsigned char>(c)];
+        }
+
+        static constexpr bool is(char c, CHAR_CLASS cls){
+            return info(c).cls == cls;
+        }
+
+        static constexpr lexeme scan(std::string_view input){
+            using enum lexeme::KIND;
+
+            const auto& first = info(input.front());
+            size_t i = 1;
+
+            switch(first.cls){
+            case CHAR_CLASS::OPERATOR:
+                return {TOKEN, first.type, 1};
+
+            case CHAR_CLASS::SPACE:
+                while(i < input.size() && is(input[i], CHAR_CLASS::SPACE)){
+                    ++i;
+                }
+                return {SPACE, {}, i};
+
+            case CHAR_CLASS::ALPHA:
+                while(i < input.size() &&
+                    (is(input[i], CHAR_CLASS::ALPHA) || is(input[i], CHAR_CLASS::DIGIT))
+                ){
+                    ++i;
+                }
+
+                return {
+                    TOKEN, 
+                    keywords::find(input.substr(0, i)).value_or(TOKEN_TYPE::VAR), 
+                    i
+                };
+
+            case CHAR_CLASS::DIGIT: [[fallthrough]];
+            case CHAR_CLASS::DOT:
+                // same language as ([0-9]*[.])?[0-9]+([eE][+-]?[0-9]+)?
+                i = 0;
+                while(i < input.size() && is(input[i], CHAR_CLASS::DIGIT)){
+                    ++i;
+                }
+
+                if(i + 1 < input.size() &&
+                    is(input[i], CHAR_CLASS::DOT) &&
+                    is(input[i + 1], CHAR_CLASS::DIGIT)
+                ){
+                    i += 2;
+                    while(i < input.size() && is(input[i], CHAR_CLASS::DIGIT)){
+                        ++i;
+                    }
+                }
+
+                if(i == 0){
+                    break;
+                }
+
+                // ([eE][+-]?[0-9]+)?, left to the next token if no digit follows
+                if(i < input.size() && (input[i] == 'e' || input[i] == 'E')){
+                    size_t j = i + 1;
+                    if(j < input.size() && (input[j] == '+' || input[j] == '-')){
+                        ++j;
+                    }
+
+                    if(j < input.size() && is(input[j], CHAR_CLASS::DIGIT)){
+                        i = j;
+                        while(i < input.size() && is(input[i], CHAR_CLASS::DIGIT)){
+                            ++i;
+                        }
+                    }
+                }
+
+                return {TOKEN, TOKEN_TYPE::LIT, i};
+
+            default:
+                break;
+            }
+
+            return {UNKNOWN, {}, input.size()};
+        }
+    };
+
+#ifdef CALC_TABLE_LEXER
+    using default_lexer = table_lexer;
+#else
+    using default_lexer = ctre_lexer;
+#endif
+}
+}
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef _MY_LIMITS_
+#define _MY_LIMITS_
+
+#include <cstddef>
+#include <cstdint>
+
+namespace calc{
+
+    // caps on the work a single expression can cause, for input coming from
+    // untrusted sources. 0 is no limit, the default. Going over one is a
+    // LIMIT_EXCEEDED error with the span of the token where it happened
+    struct limits{
+        // characters of the expression
+        size_t length = 0;
+        size_t tokens = 0;
+        // brackets, functions and operators waiting for their operand at
+        // the same time
+        size_t depth = 0;
+        // per evaluation: one per operator applied plus the iterations of
+        // the powers, one per bit of the exponent. Counted on what runs:
+        // the integer formulas computed exactly are folded when compiling,
+        // they are free for every evaluator. Batches aren't limited
+        size_t steps = 0;
+    };
+
+namespace{
+
+    // the limit as the largest allowed count
+    constexpr size_t budget(size_t limit){
+        return limit == 0 ? SIZE_MAX : limit;
+    }
+}
+}
+
+#endif
@@ -1,14 +1,24 @@
 #ifndef _MY_MATH_UTILS_
 #define _MY_MATH_UTILS_
 
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
 #include <concepts>
+#include <cstdint>
 #include <limits>
+#include <optional>
 
 namespace calc{
     using num_t = double;
 
+    // types the engine can evaluate with, num_t by default: the floating
+    // point ones and checked 64 bit integers
+    template<typename T>
+    concept number = std::floating_point<T> || std::same_as<T, int64_t>;
+
 namespace math_utils{
-    static constexpr double epsilon = 1.e-12;
 
     // struct complex{
     //     double real;
@@ -28,51 +38,270 @@ namespace math_utils{
         return static_cast<T>(0);
     };
 
-    constexpr bool equal(num_t v1, num_t v2){
-        return std::fabs(v1 - v2) < epsilon;
+    // tolerance of the comparisons: a few units in the last place of 1,
+    // integers compare exactly
+    template<number T>
+    inline constexpr T epsilon = static_cast<T>(std::numeric_limits<T>::epsilon() * 16);
+
+    template<>
+    inline constexpr double epsilon<double> = 1.e-12;
+
+    template<>
+    inline constexpr int64_t epsilon<int64_t> = 0;
+
+    template<number T>
+    constexpr bool equal(T v1, T v2){
+        if constexpr(std::integral<T>){
+            return v1 == v2;
+        }
+        else{
+            return std::fabs(v1 - v2) < epsilon<T>;
+        }
     }
 
-    constexpr bool is_zero(num_t v1){
-        return equal(v1, zero_element<num_t>());
+    // v1 == v2 without tolerance
+    template<number T>
+    constexpr bool same(T v1, T v2){
+        if constexpr(std::integral<T>){
+            return v1 == v2;
+        }
+        else{
+            return !std::isless(v1, v2) && !std::isgreater(v1, v2);
+        }
     }
 
-    constexpr num_t remove_decimal_part(num_t v){
-        return std::round(v);
+    template<number T>
+    constexpr bool is_zero(T v1){
+        return equal(v1, zero_element<T>());
     }
 
-    constexpr bool is_integer(num_t v1){
+    template<number T>
+    constexpr T remove_decimal_part(T v){
+        if constexpr(std::integral<T>){
+            return v;
+        }
+        else{
+            return std::round(v);
+        }
+    }
+
+    template<number T>
+    constexpr bool is_integer(T v1){
         return equal(v1, remove_decimal_part(v1));
     }
 
-    constexpr std::optional<num_t> safe_add(num_t l, num_t r){
-        const auto ret = l + r;
-        if(!std::isfinite(ret)){
-            return std::nullopt;
+    // the checks below fail when the result doesn't fit: for floating point
+    // types it isn't finite, for integers the operation wrapped
+
+    template<number T>
+    constexpr std::optional<T> safe_add(T l, T r){
+        T ret;
+        if constexpr(std::integral<T>){
+            if(__builtin_add_overflow(l, r, &ret)){
+                return std::nullopt;
+            }
+        }
+        else{
+            ret = l + r;
+            if(!std::isfinite(ret)){
+                return std::nullopt;
+            }
         }
 
         return ret;
     }
 
-    constexpr std::optional<num_t> safe_sub(num_t l, num_t r){
-        return safe_add(l, static_cast<num_t>(-r));
+    template<number T>
+    constexpr std::optional<T> safe_sub(T l, T r){
+        if constexpr(std::integral<T>){
+            T ret;
+            if(__builtin_sub_overflow(l, r, &ret)){
+                return std::nullopt;
+            }
+
+            return ret;
+        }
+        else{
+            return safe_add(l, static_cast<T>(-r));
+        }
     }
 
-    constexpr std::optional<num_t> safe_mult(num_t l, num_t r){
-        const auto ret = l * r;
-        if(!std::isfinite(ret)){
-            return std::nullopt;
+    template<number T>
+    constexpr std::optional<T> safe_mult(T l, T r){
+        T ret;
+        if constexpr(std::integral<T>){
+            if(__builtin_mul_overflow(l, r, &ret)){
+                return std::nullopt;
+            }
+        }
+        else{
+            ret = l * r;
+            if(!std::isfinite(ret)){
+                return std::nullopt;
+            }
         }
 
         return ret;
     }
 
-    constexpr std::optional<num_t> safe_div(num_t l, num_t r){
-        const auto ret = l / r;
-        if(!std::isfinite(ret)){
-            return std::nullopt;
+    // r is not 0, integers are truncated towards 0
+    template<number T>
+    constexpr std::optional<T> safe_div(T l, T r){
+        if constexpr(std::integral<T>){
+            if(l == std::numeric_limits<T>::min() && r == -1){
+                return std::nullopt;
+            }
+
+            return static_cast<T>(l / r);
+        }
+        else{
+            const auto ret = l / r;
+            if(!std::isfinite(ret)){
+                return std::nullopt;
+            }
+
+            return ret;
+        }
+    }
+
+    // only the smallest integer has no opposite
+    template<number T>
+    constexpr std::optional<T> safe_neg(T v){
+        if constexpr(std::integral<T>){
+            if(v == std::numeric_limits<T>::min()){
+                return std::nullopt;
+            }
+        }
+
+        return static_cast<T>(-v);
+    }
+
+    template<number T>
+    constexpr std::optional<T> safe_abs(T v){
+        if constexpr(std::integral<T>){
+            if(v < 0){
+                return safe_neg(v);
+            }
+
+            return v;
+        }
+        else{
+            return std::fabs(v);
+        }
+    }
+
+    // b^e for an integer e >= 0 by squaring, at most 2 * log2(e)
+    // multiplications. Fails as soon as a step overflows: the squares only
+    // grow when |b| > 1, so the result would overflow too
+    template<number T>
+    constexpr std::optional<T> pow(T b, T e){
+        T ret = 1;
+
+        while(true){
+            bool odd;
+            if constexpr(std::integral<T>){
+                odd = e % 2 != 0;
+                e /= 2;
+            }
+            else{
+                odd = std::isgreater(std::fmod(e, static_cast<T>(2)), static_cast<T>(0));
+                e = std::floor(e / static_cast<T>(2));
+            }
+
+            if(odd){
+                const auto tmp = safe_mult(ret, b);
+                if(!tmp){
+                    return std::nullopt;
+                }
+                ret = *tmp;
+            }
+
+            if(!(e > 0)){
+                return ret;
+            }
+
+            const auto tmp = safe_mult(b, b);
+            if(!tmp){
+                return std::nullopt;
+            }
+            b = *tmp;
+        }
+    }
+
+    // iterations of pow() for the exponent e or -e, one per bit. 0 when
+    // e isn't finite, pow() isn't called then
+    template<number T>
+    constexpr size_t pow_steps(T e){
+        if constexpr(std::integral<T>){
+            const auto magnitude = e < 0 ? 0 - static_cast<uint64_t>(e) : static_cast<uint64_t>(e);
+
+            return std::max<size_t>(std::bit_width(magnitude), 1);
+        }
+        else{
+            if(!std::isfinite(e)){
+                return 0;
+            }
+            if(std::isless(std::fabs(e), static_cast<T>(1))){
+                return 1;
+            }
+
+            return static_cast<size_t>(std::ilogb(e)) + 1;
+        }
+    }
+
+    // number of factorials which fit in T, from 0!
+    template<number T>
+    consteval size_t factorial_count(){
+        T f = 1;
+        size_t n = 1;
+
+        while(true){
+            if constexpr(std::integral<T>){
+                if(__builtin_mul_overflow(f, static_cast<T>(n), &f)){
+                    return n;
+                }
+            }
+            else{
+                // an overflow isn't a constant expression
+                if(f > std::numeric_limits<T>::max() / static_cast<T>(n)){
+                    return n;
+                }
+                f *= static_cast<T>(n);
+            }
+            ++n;
+        }
+    }
+
+    // every factorial which fits in T
+    template<number T>
+    inline constexpr auto factorials = []{
+        std::array<T, factorial_count<T>()> ret{};
+        ret[0] = 1;
+
+        for(size_t i = 1; i < ret.size(); ++i){
+            ret[i] = static_cast<T>(ret[i - 1] * static_cast<T>(i));
         }
 
         return ret;
+    }();
+
+    // n! for an integer n >= 0, a single lookup
+    template<number T>
+    constexpr std::optional<T> factorial(T n){
+        constexpr auto last = static_cast<T>(factorials<T>.size() - 1);
+
+        if constexpr(std::integral<T>){
+            if(n > last){
+                return std::nullopt;
+            }
+        }
+        else{
+            if(!std::islessequal(n, last)){
+                return std::nullopt;
+            }
+        }
+
+        return factorials<T>[static_cast<size_t>(n)];
     }
 
 }
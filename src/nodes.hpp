@@ -1,387 +1,694 @@
 #ifndef _MY_EXPR_NODES_
 #define _MY_EXPR_NODES_
 
+#include <cassert>
+#include <bit>
 #include <concepts>
+#include <cstdint>
+#include <optional>
+#include <span>
 #include <stdfloat>
+#include <vector>
 
-namespace calc{
-    using evaluation_t = std::expected<num_t, calc_err>;
+#include "kernels.hpp"
+#include "bytecode.hpp"
 
+namespace calc{
 namespace{
 
-    using token = tokenizer::token;
+    using node_idx = uint32_t;
+
+    struct node{
+        OPCODE op;
+        // the subtree has only integer literals, it is evaluated with
+        // integers first. Set by the tree, only for floating point values
+        bool integral;
+        // LIT: index in the constants, VAR: variable slot,
+        // operators: index of the operands (rhs unused by unary ones)
+        node_idx lhs;
+        node_idx rhs;
+    };
 
-    struct expr{
-        token tok;
-        constexpr virtual evaluation_t evaluate() const = 0;
-        constexpr virtual ~expr() = default;
+    // the whole tree lives in a few contiguous buffers: nodes refer to their
+    // children by index and are released all together. Children always come
+    // before their parent, in the order they are evaluated, and every node
+    // can be reached from the root, which is the last one
+    template<number T>
+    struct basic_ast{
+        std::vector<node> nodes;
+        // source span of each node, only read to build errors
+        std::vector<token> tokens;
+        std::vector<T> constants;
+        node_idx root = 0;
+        // the builders return the existing node equal to the one requested,
+        // which keeps the span of its first occurrence: identical subtrees
+        // are stored once and the tree becomes a DAG
+        bool hash_consing = false;
+
+        constexpr void clear(){
+            nodes.clear();
+            tokens.clear();
+            constants.clear();
+            root = 0;
+            dedup.clear();
+        }
 
-        constexpr expr(token&& t): tok(std::move(t)){}
-    };
+        constexpr bool empty() const {
+            return nodes.empty();
+        }
 
-    using expr_ptr_t = std::unique_ptr<expr>;
+        // full_expr is the buffer the tokens point into, it is only read
+        // when an error has to be reported. vars holds the value of each
+        // variable slot. The nodes are evaluated in order, each once: a
+        // shared subtree isn't computed again. Integral operators are exact,
+        // see exact_values(). At most steps steps, see limits::steps
+        constexpr basic_evaluation_t<T> evaluate(
+            std::string_view full_expr,
+            std::span<const T> vars,
+            size_t steps = SIZE_MAX
+        ) const {
+            assert(!empty() && root == nodes.size() - 1);
+
+            std::vector<T> values(nodes.size());
+            // sized at the first integral operator
+            std::vector<std::optional<int64_t>> exact;
+
+            for(size_t i = 0; i < nodes.size(); ++i){
+                const auto& n = nodes[i];
+                const auto& tok = tokens[i];
+                basic_evaluation_t<T> res;
+
+                // free, like the literal lower() makes of it
+                if(n.integral && n.op != OPCODE::LIT){
+                    exact.resize(nodes.size());
+                    exact[i] = exact_value(n, exact);
+                    if(exact[i]){
+                        values[i] = static_cast<T>(*exact[i]);
+                        continue;
+                    }
+                }
 
-    struct binary_op : expr{
-        using fun_t = evaluation_t(*)(num_t, num_t, const token&);
+                if(n.op != OPCODE::LIT && n.op != OPCODE::VAR){
+                    const auto cost = kernels::steps(n.op, values[is_binary(n.op) ? n.rhs : n.lhs]);
+                    if(cost > steps){
+                        return kernels::step_limit(tok, full_expr);
+                    }
+                    steps -= cost;
+                }
 
-        expr_ptr_t op1;
-        expr_ptr_t op2;
-        fun_t fun;
+                switch(n.op){
+                case OPCODE::LIT:
+                    values[i] = constants[n.lhs];
+                    continue;
 
-        constexpr evaluation_t evaluate() const {
-            auto a = op1->evaluate();
-            if(!a){
-                return a;
+                case OPCODE::VAR:
+                    if(n.lhs >= vars.size()){
+                        return kernels::unbound_variable(tok, full_expr);
+                    }
+                    values[i] = vars[n.lhs];
+                    continue;
+
+                default:
+                    res = is_binary(n.op) ?
+                        kernels::apply(n.op, values[n.lhs], values[n.rhs], tok, full_expr) :
+                        kernels::apply(n.op, values[n.lhs], tok, full_expr);
+                    break;
+                }
+
+                if(!res){
+                    return res;
+                }
+
+                values[i] = *res;
             }
 
-            auto b = op2->evaluate();
-            if(!b){
-                return b;
+            return values[root];
+        }
+
+        // value of each integral operator computed with 64 bit integers,
+        // nullopt for the other nodes and where the result isn't an integer
+        // or doesn't fit: those are left to the floating point kernels, so
+        // the errors don't change. Integer only formulas are exact as long
+        // as the intermediate results fit, only the result is rounded
+        constexpr std::vector<std::optional<int64_t>> exact_values() const {
+            std::vector<std::optional<int64_t>> ret(nodes.size());
+
+            for(size_t i = 0; i < nodes.size(); ++i){
+                if(nodes[i].integral && nodes[i].op != OPCODE::LIT){
+                    ret[i] = exact_value(nodes[i], ret);
+                }
             }
 
-            return fun(*a, *b, tok);
+            return ret;
         }
 
-        static constexpr expr_ptr_t add(
-            token&& t,
-            expr_ptr_t&& l, 
-            expr_ptr_t&& r
-        ){
-            return binary_op_with_fun(std::move(t), std::move(l), std::move(r), 
-                [](num_t a, num_t b, const token& tok) constexpr -> evaluation_t {
-                    auto ret = math_utils::safe_add(a, b);
-                    if(ret){
-                        return *ret;
-                    }
+        // appends the tree to p in postfix order. An operator used by more
+        // than one parent is stored in a register the first time and loaded
+        // the next ones. Integral subtrees with an exact value become a
+        // literal
+        constexpr void lower(basic_program<T>& p) const {
+            assert(!empty());
+
+            constexpr uint32_t no_register = UINT32_MAX;
+
+            const auto exact = exact_values();
 
-                    return std::unexpected(
-                        calc_err::error_with_wrong_token(
-                            calc_err_type_t::OVERFLOW_UNDERFLOW, 
-                            "overflow/underflow detected",
-                            tok.full_expr,
-                            tok.start,
-                            tok.end
-                        )
-                    );
-                }
-            );       
+            std::vector<uint32_t> uses(nodes.size());
+            for(const auto& n : nodes){
+                if(n.op != OPCODE::LIT && n.op != OPCODE::VAR){
+                    ++uses[n.lhs];
+                    uses[n.rhs] += is_binary(n.op);
+                }
+            }
+
+            std::vector<uint32_t> reg(nodes.size(), no_register);
+            uint32_t registers = 0;
+
+            const auto enter = [&](node_idx i){
+                if(exact[i]){
+                    p.emit_literal(tokens[i], static_cast<T>(*exact[i]));
+                    return false;
+                }
+
+                if(reg[i] == no_register){
+                    return true;
+                }
+
+                p.emit(OPCODE::LOAD, tokens[i], reg[i]);
+                return false;
+            };
+
+            post_order([&](node_idx i){
+                const auto& n = nodes[i];
+
+                if(n.op == OPCODE::LIT){
+                    p.emit_literal(tokens[i], constants[n.lhs]);
+                    return true;
+                }
+
+                p.emit(n.op, tokens[i], n.op == OPCODE::VAR ? n.lhs : 0);
+
+                if(n.op != OPCODE::VAR && uses[i] > 1){
+                    reg[i] = registers++;
+                    p.emit(OPCODE::STORE, tokens[i], reg[i]);
+                }
+
+                return true;
+            }, enter);
         }
 
-        static constexpr expr_ptr_t sub(
-            token&& t,
-            expr_ptr_t&& l, 
-            expr_ptr_t&& r
-        ){
-            return binary_op_with_fun(std::move(t), std::move(l), std::move(r), 
-                [](num_t a, num_t b, const token& tok) constexpr -> evaluation_t {
-                    auto ret = math_utils::safe_sub(a, b);
-                    if(ret){
-                        return *ret;
-                    }
+        // rebuilds the tree with hash consing, which stays on. Returns how
+        // many nodes were merged
+        constexpr size_t deduplicate(){
+            assert(!empty());
 
-                    return std::unexpected(
-                        calc_err::error_with_wrong_token(
-                            calc_err_type_t::OVERFLOW_UNDERFLOW, 
-                            "overflow/underflow detected",
-                            tok.full_expr,
-                            tok.start,
-                            tok.end
-                        )
-                    );
-                }
-            );   
+            const size_t before = nodes.size();
+
+            basic_ast out;
+            out.hash_consing = true;
+            std::vector<node_idx> map(nodes.size());
+            for(size_t i = 0; i < nodes.size(); ++i){
+                const auto& n = nodes[i];
+                auto tok = tokens[i];
+
+                if(n.op == OPCODE::LIT){
+                    map[i] = out.literal(std::move(tok), constants[n.lhs]);
+                }
+                else if(n.op == OPCODE::VAR){
+                    map[i] = out.variable(std::move(tok), n.lhs);
+                }
+                else{
+                    map[i] = out.push(std::move(tok), n.op, map[n.lhs], is_binary(n.op) ? map[n.rhs] : 0);
+                }
+            }
+            out.root = map[root];
+
+            *this = std::move(out);
+
+            return before - nodes.size();
         }
 
-        static constexpr expr_ptr_t mult(
-            token&& t,
-            expr_ptr_t&& l, 
-            expr_ptr_t&& r
-        ){
-            return binary_op_with_fun(std::move(t), std::move(l), std::move(r), 
-                [](num_t a, num_t b, const token& tok) constexpr -> evaluation_t {
-                    auto ret = math_utils::safe_mult(a, b);
-                    if(ret){
-                        return *ret;
-                    }
+        // folds the constant subtrees and applies identities which can't
+        // change the result ((x - y) * 1, -(-(x - y)), floor(floor(x)), ...).
+        // Subtrees whose evaluation fails are kept as they are, so the error
+        // is still reported with its span when the tree is evaluated.
+        // Returns how many nodes were removed
+        constexpr size_t simplify(std::string_view full_expr){
+            assert(!empty());
+
+            const size_t before = nodes.size();
+
+            // children come before their parent, one forward pass sees every
+            // operand already simplified
+            basic_ast out;
+            out.hash_consing = hash_consing;
+            std::vector<node_idx> map(nodes.size());
+            // of the nodes of out, see exact_values()
+            std::vector<std::optional<int64_t>> exact;
+            for(size_t i = 0; i < nodes.size(); ++i){
+                map[i] = out.simplified(nodes[i], tokens[i], constants, map, exact, full_expr);
+
+                for(size_t j = exact.size(); j < out.nodes.size(); ++j){
+                    const auto& m = out.nodes[j];
+                    exact.push_back(m.integral && m.op != OPCODE::LIT ? out.exact_value(m, exact) : std::nullopt);
+                }
+            }
+            out.root = map[root];
+            out.compact();
+
+            *this = std::move(out);
 
-                    return std::unexpected(
-                        calc_err::error_with_wrong_token(
-                            calc_err_type_t::OVERFLOW_UNDERFLOW, 
-                            "overflow/underflow detected",
-                            tok.full_expr,
-                            tok.start,
-                            tok.end
-                        )
-                    );
-                }
-            );   
+            return before - nodes.size();
         }
 
-        static constexpr expr_ptr_t div(
-            token&& t,
-            expr_ptr_t&& l, 
-            expr_ptr_t&& r
-        ){
-            return binary_op_with_fun(std::move(t), std::move(l), std::move(r), 
-                [](num_t n, num_t d, const token& tok) constexpr -> evaluation_t {
-                    if(math_utils::is_zero(d)){
-                        return std::unexpected(
-                            calc_err::error_with_wrong_token(
-                                calc_err_type_t::DIVISION_BY_ZERO, 
-                                "Division by 0 detected",
-                                tok.full_expr,
-                                tok.start,
-                                tok.end
-                            )
-                        );
-                    }
+        // the operator is the opcode, the parser reads it from its table
+        constexpr node_idx binary(OPCODE op, token&& t, node_idx l, node_idx r){
+            assert(is_binary(op));
 
-                    auto ret = math_utils::safe_div(n, d);
-                    if(ret){
-                        return *ret;
-                    }
+            return push(std::move(t), op, l, r);
+        }
+
+        constexpr node_idx unary(OPCODE op, token&& t, node_idx data){
+            assert(!is_binary(op) && op != OPCODE::LIT && op != OPCODE::VAR);
 
-                    return std::unexpected(
-                        calc_err::error_with_wrong_token(
-                            calc_err_type_t::OVERFLOW_UNDERFLOW, 
-                            "overflow/underflow detected",
-                            tok.full_expr,
-                            tok.start,
-                            tok.end
-                        )
-                    );
-                }
-            );   
+            return push(std::move(t), op, data);
         }
 
-        static constexpr expr_ptr_t exponent(
-            token&& t,
-            expr_ptr_t&& l, 
-            expr_ptr_t&& r
-        ){
-            return binary_op_with_fun(std::move(t), std::move(l), std::move(r), 
-                [](num_t b, num_t e, const token& tok) constexpr -> evaluation_t {
-                    // auto ret = std::pow(b, e); constexpr since c++26
-                    if(!math_utils::is_integer(e) || std::isless(e, 0)){
-                        return std::unexpected(
-                            calc_err::error_with_wrong_token(
-                                calc_err_type_t::UNEXPECTED_VALUE,
-                                "Exponent must be >=0 and integer",
-                                tok.full_expr,
-                                tok.start,
-                                tok.end
-                            )
-                        );
-                    }
+        constexpr node_idx literal(token&& t, T n){
+            constants.push_back(n);
 
-                    if(math_utils::is_zero(b) || math_utils::equal(b, 1)){
-                        return 1;
-                    }
+            const size_t before = nodes.size();
+            const node_idx ret = push(std::move(t), OPCODE::LIT, static_cast<node_idx>(constants.size() - 1));
+            if(nodes.size() == before){
+                // merged with an equal literal
+                constants.pop_back();
+            }
 
-                    e = math_utils::remove_decimal_part(e);
-                    
-                    num_t ret = 1;
-                    while(!math_utils::is_zero(e)){
-                        auto tmp = math_utils::safe_mult(ret, b);
-                        if(!tmp){
-                            return std::unexpected(
-                                calc_err::error_with_wrong_token(
-                                    calc_err_type_t::OVERFLOW_UNDERFLOW, 
-                                    "overflow/underflow detected",
-                                    tok.full_expr,
-                                    tok.start,
-                                    tok.end
-                                )
-                            );
-                        }
-                        ret = *tmp;
-                        --e;
-                    }
+            return ret;
+        }
 
-                    return ret;
-                }
-            );   
+        // slot is the index in the values passed to evaluate(), resolved by
+        // the parser
+        constexpr node_idx variable(token&& t, size_t slot){
+            return push(std::move(t), OPCODE::VAR, static_cast<node_idx>(slot));
         }
 
     private:
-        static constexpr expr_ptr_t binary_op_with_fun(
-            token&& t,
-            expr_ptr_t&& l, 
-            expr_ptr_t&& r, 
-            fun_t f
-        ){
-            return std::unique_ptr<binary_op>(
-                new binary_op(
-                    std::move(t),
-                    std::move(l), 
-                    std::move(r), 
-                    f
-                )
-            );
-        }
+        static constexpr node_idx empty_slot = UINT32_MAX;
 
-        constexpr binary_op(
-            token&& t,
-            expr_ptr_t&& l, 
-            expr_ptr_t&& r, 
-            fun_t f
-        ) noexcept:
-            expr::expr(std::move(t)),
-            op1(std::move(l)), 
-            op2(std::move(r)),
-            fun(f)
-        {}
+        // open addressing table of the nodes for hash consing, linear
+        // probing, at most half full
+        std::vector<node_idx> dedup;
 
-    };
+        constexpr node_idx push(token&& t, OPCODE op, node_idx l, node_idx r = 0){
+            const node n{op, is_integral(op, l, r), l, r};
+            node_idx* slot = nullptr;
 
-    struct unary_op : expr{
-        using fun_t = evaluation_t(*)(num_t, const token& tok);
-        
-        expr_ptr_t data;
-        fun_t fun;
+            if(hash_consing){
+                if(2 * (nodes.size() + 1) > dedup.size()){
+                    rehash(std::max<size_t>(16, 2 * dedup.size()));
+                }
 
-        constexpr evaluation_t evaluate() const{
-            auto ret = data->evaluate();
-            if(!ret){
-                return ret;
+                slot = &find_slot(n);
+                if(*slot != empty_slot){
+                    return *slot;
+                }
             }
 
-            return fun(*ret, tok);
+            nodes.push_back(n);
+            tokens.push_back(std::move(t));
+
+            const auto ret = static_cast<node_idx>(nodes.size() - 1);
+            if(slot){
+                *slot = ret;
+            }
+
+            return ret;
         }
-        
-        static constexpr expr_ptr_t neg(token&& t, expr_ptr_t&& data){
-            return unary_op_with_fun(
-                std::move(t),
-                std::move(data), 
-                [](num_t n, [[maybe_unused]] const token& tok) constexpr -> evaluation_t {
-                    return -n;
+
+        // literals are equal when their values are, the other nodes when
+        // their operands are: these are already unique
+        constexpr bool same(const node& a, const node& b) const {
+            if(a.op != b.op){
+                return false;
+            }
+
+            if(a.op != OPCODE::LIT){
+                return a.lhs == b.lhs && a.rhs == b.rhs;
+            }
+
+            const T x = constants[a.lhs];
+            const T y = constants[b.lhs];
+            if constexpr(std::floating_point<T>){
+                // 0 and -0 differ
+                if(std::signbit(x) != std::signbit(y)){
+                    return false;
                 }
-            );
+            }
+
+            return math_utils::same(x, y);
         }
 
-        static constexpr expr_ptr_t factorial(token&& t, expr_ptr_t&& data){
-            using enum calc_err_type_t;
-            return unary_op_with_fun(
-                std::move(t),
-                std::move(data), 
-                [](num_t n, const token& tok) constexpr -> evaluation_t {
-
-                    if(std::isless(n, 0)){
-                        return std::unexpected(
-                            calc_err::error_with_wrong_token(
-                                calc_err_type_t::UNEXPECTED_VALUE, 
-                                "Factorial can't be applied to a negative value",
-                                tok.full_expr,
-                                tok.start,
-                                tok.end
-                            )
-                        );
-                    }
+        // equal nodes have the same key
+        constexpr uint64_t key(const node& n) const {
+            if(n.op != OPCODE::LIT){
+                return uint64_t{n.lhs} << 32 | n.rhs;
+            }
 
-                    n = math_utils::remove_decimal_part(n);
-
-                    num_t ret = 1;
-                    while(std::isgreater(n, 1.)){
-
-                        auto tmp = math_utils::safe_mult(ret, n);
-                        if(!tmp){
-                            return std::unexpected(
-                                calc_err::error_with_wrong_token(
-                                    calc_err_type_t::OVERFLOW_UNDERFLOW,
-                                    "overflow detected",
-                                    tok.full_expr,
-                                    tok.start,
-                                    tok.end
-                                )
-                            );
-                        }
-                        ret = *tmp;
-
-                        --n;
-                    }
+            if constexpr(std::integral<T>){
+                return static_cast<uint64_t>(constants[n.lhs]);
+            }
+            else{
+                return std::bit_cast<uint64_t>(static_cast<double>(constants[n.lhs]));
+            }
+        }
+
+        constexpr size_t hash(const node& n) const {
+            // splitmix64 finaliser
+            uint64_t h = key(n) ^ (static_cast<uint64_t>(n.op) * 0x9e3779b97f4a7c15);
+            h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9;
+            h = (h ^ (h >> 27)) * 0x94d049bb133111eb;
 
-                    return ret;
+            return static_cast<size_t>(h ^ (h >> 31));
+        }
+
+        // the slot holding a node equal to n, or the empty one where it goes
+        constexpr node_idx& find_slot(const node& n){
+            const size_t mask = dedup.size() - 1;
+
+            for(size_t i = hash(n) & mask;; i = (i + 1) & mask){
+                const node_idx j = dedup[i];
+                if(j == empty_slot || same(nodes[j], n)){
+                    return dedup[i];
                 }
-            );
+            }
         }
 
-        static constexpr expr_ptr_t abs(token&& t, expr_ptr_t&& data){
-            using enum calc_err_type_t;
-            return unary_op_with_fun(
-                std::move(t),
-                std::move(data), 
-                [](num_t n, [[maybe_unused]] const token& tok) constexpr -> evaluation_t {
-                    return std::fabs(n);
+        constexpr void rehash(size_t size){
+            dedup.assign(size, empty_slot);
+
+            for(size_t i = 0; i < nodes.size(); ++i){
+                find_slot(nodes[i]) = static_cast<node_idx>(i);
+            }
+        }
+
+        // literals must be integers in the range of int64_t, so that the
+        // conversion is exact. -0 isn't, its sign would be lost
+        constexpr bool is_integral(OPCODE op, node_idx l, node_idx r) const {
+            if constexpr(std::floating_point<T>){
+                switch(op){
+                case OPCODE::LIT:
+                {
+                    const T v = constants[l];
+                    return math_utils::same(v, std::trunc(v)) &&
+                        !(math_utils::is_zero(v) && std::signbit(v)) &&
+                        !std::isless(v, static_cast<T>(-0x1p63)) &&
+                        std::isless(v, static_cast<T>(0x1p63));
                 }
-            );
+                case OPCODE::VAR:
+                    return false;
+                default:
+                    return nodes[l].integral && (!is_binary(op) || nodes[r].integral);
+                }
+            }
+            else{
+                return false;
+            }
         }
 
-        static constexpr expr_ptr_t floor(token&& t, expr_ptr_t&& data){
-            using enum calc_err_type_t;
-            return unary_op_with_fun(
-                std::move(t),
-                std::move(data), 
-                [](num_t n, [[maybe_unused]] const token& tok) constexpr -> evaluation_t {
-                    return std::floor(n);
+        // n is an integral operator, known holds the exact values of the
+        // operators before it
+        constexpr std::optional<int64_t> exact_value(
+            const node& n, 
+            std::span<const std::optional<int64_t>> known
+        ) const {
+            const auto operand = [&](node_idx j) -> std::optional<int64_t> {
+                if(nodes[j].op == OPCODE::LIT){
+                    return static_cast<int64_t>(constants[nodes[j].lhs]);
                 }
+
+                return known[j];
+            };
+
+            const auto a = operand(n.lhs);
+            if(!a){
+                return std::nullopt;
+            }
+
+            std::optional<int64_t> b = 0;
+            if(is_binary(n.op)){
+                b = operand(n.rhs);
+                if(!b){
+                    return std::nullopt;
+                }
+            }
+
+            // narrow types can't hold every int64_t
+            const auto ret = kernels::exact(n.op, *a, *b);
+            if(!ret || !std::isfinite(static_cast<T>(*ret))){
+                return std::nullopt;
+            }
+
+            // the operands are never -0, these are the only operators whose
+            // floating point result can be: -0 is left to the kernels
+            const bool negative_zero = *ret == 0 && (
+                n.op == OPCODE::NEG ||
+                ((n.op == OPCODE::MULT || n.op == OPCODE::DIV) && (*a < 0 || *b < 0))
             );
+            if(negative_zero){
+                return std::nullopt;
+            }
+
+            return ret;
+        }
+
+        constexpr bool is_constant(node_idx i, T v) const {
+            const auto& n = nodes[i];
+
+            // exact comparison, identities must not round nor change the
+            // sign of a zero
+            return n.op == OPCODE::LIT && 
+                math_utils::same(constants[n.lhs], v) &&
+                std::signbit(constants[n.lhs]) == std::signbit(v);
         }
 
-        static constexpr expr_ptr_t ceil(token&& t, expr_ptr_t&& data){
-            using enum calc_err_type_t;
-            return unary_op_with_fun(
-                std::move(t),
-                std::move(data), 
-                [](num_t n, [[maybe_unused]] const token& tok) constexpr -> evaluation_t {
-                    return std::ceil(n);
+        // whether an identity can replace its operator with i: the result of
+        // the binary operators and the factorial is checked, so finite, while
+        // a variable can be inf or NaN, which the operator would report. The
+        // other unary operators pass them through
+        constexpr bool is_checked(node_idx i) const {
+            if constexpr(std::floating_point<T>){
+                while(nodes[i].op == OPCODE::NEG || nodes[i].op == OPCODE::ABS ||
+                    nodes[i].op == OPCODE::FLOOR || nodes[i].op == OPCODE::CEIL
+                ){
+                    i = nodes[i].lhs;
                 }
-            );
+
+                return nodes[i].op != OPCODE::VAR;
+            }
+            else{
+                return true;
+            }
         }
 
-    private:
-        static constexpr expr_ptr_t unary_op_with_fun(
-            token&& t,
-            expr_ptr_t&& ptr, 
-            fun_t f
+        // appends n, taken from another tree, whose operands have already
+        // been appended and are found through map. exact holds the exact
+        // values of the nodes of this tree. Returns its new index, which can
+        // be the one of an operand
+        constexpr node_idx simplified(
+            const node& n,
+            const token& tok,
+            std::span<const T> from_constants,
+            std::span<const node_idx> map,
+            std::span<const std::optional<int64_t>> exact,
+            std::string_view full_expr
         ){
-            return std::unique_ptr<unary_op>(
-                new unary_op(
-                    std::move(t),
-                    std::move(ptr), 
-                    f
-                )
-            );
+            switch(n.op){
+            case OPCODE::LIT:
+                return literal(token{tok}, from_constants[n.lhs]);
+
+            case OPCODE::VAR:
+                return variable(token{tok}, n.lhs);
+
+            default:
+                break;
+            }
+
+            const node_idx l = map[n.lhs];
+            const node_idx r = is_binary(n.op) ? map[n.rhs] : 0;
+            const auto& lhs = nodes[l];
+
+            // integer formulas are folded like evaluate() computes them. A
+            // value T can't hold stays a subtree, its parents are still
+            // exact and lower() folds the whole formula
+            std::optional<int64_t> v;
+            if constexpr(std::floating_point<T>){
+                if(is_integral(n.op, l, r)){
+                    v = exact_value(node{n.op, true, l, r}, exact);
+
+                    const T folded = v ? static_cast<T>(*v) : T{};
+                    if(v && std::isless(folded, static_cast<T>(0x1p63)) && static_cast<int64_t>(folded) == *v){
+                        return literal(token{tok}, folded);
+                    }
+                }
+            }
+
+            if(!v && lhs.op == OPCODE::LIT && (!is_binary(n.op) || nodes[r].op == OPCODE::LIT)){
+                auto res = is_binary(n.op) ?
+                    kernels::apply(n.op, constants[lhs.lhs], constants[nodes[r].lhs], tok, full_expr) :
+                    kernels::apply(n.op, constants[lhs.lhs], tok, full_expr);
+
+                if(res){
+                    return literal(token{tok}, *res);
+                }
+            }
+
+            switch(n.op){
+            // -0 + 0 is +0: only -0 can be added to anything. 0 can be
+            // subtracted
+            case OPCODE::ADD:
+                if(is_constant(l, -T{0}) && is_checked(r)){
+                    return r;
+                }
+                if(is_constant(r, -T{0}) && is_checked(l)){
+                    return l;
+                }
+                break;
+
+            case OPCODE::SUB:
+                if(is_constant(r, 0) && is_checked(l)){
+                    return l;
+                }
+                break;
+
+            case OPCODE::MULT:
+                if(is_constant(l, 1) && is_checked(r)){
+                    return r;
+                }
+                [[fallthrough]];
+            case OPCODE::DIV:
+                if(is_constant(r, 1) && is_checked(l)){
+                    return l;
+                }
+                break;
+
+            // the inner negation of an integer can overflow
+            case OPCODE::NEG:
+                if(std::floating_point<T> && lhs.op == OPCODE::NEG && is_checked(lhs.lhs)){
+                    return lhs.lhs;
+                }
+                break;
+
+            case OPCODE::ABS:
+                if(lhs.op == OPCODE::ABS){
+                    return l;
+                }
+                break;
+
+            // the result of both is already an integer
+            case OPCODE::FLOOR: [[fallthrough]];
+            case OPCODE::CEIL:
+                if(lhs.op == OPCODE::FLOOR || lhs.op == OPCODE::CEIL){
+                    return l;
+                }
+                break;
+
+            default:
+                break;
+            }
+
+            return push(token{tok}, n.op, l, r);
         }
 
-        explicit constexpr unary_op(token&& t, expr_ptr_t&& ptr, fun_t f) noexcept: 
-            expr::expr(std::move(t)),
-            data(std::move(ptr)),
-            fun(f)
-        {}
-    };
+        // drops the nodes which can't be reached from the root, keeping the
+        // post order
+        constexpr void compact(){
+            std::vector<bool> live(nodes.size());
+            live[root] = true;
+
+            for(size_t i = root + 1; i-- > 0;){
+                const auto& n = nodes[i];
+                if(!live[i] || n.op == OPCODE::LIT || n.op == OPCODE::VAR){
+                    continue;
+                }
+
+                live[n.lhs] = true;
+                if(is_binary(n.op)){
+                    live[n.rhs] = true;
+                }
+            }
+
+            std::vector<node_idx> map(nodes.size());
+            std::vector<T> used_constants;
+            node_idx j = 0;
+
+            for(size_t i = 0; i < nodes.size(); ++i){
+                if(!live[i]){
+                    continue;
+                }
+
+                auto n = nodes[i];
+                if(n.op == OPCODE::LIT){
+                    used_constants.push_back(constants[n.lhs]);
+                    n.lhs = static_cast<node_idx>(used_constants.size() - 1);
+                }
+                else if(n.op != OPCODE::VAR){
+                    n.lhs = map[n.lhs];
+                    n.rhs = is_binary(n.op) ? map[n.rhs] : 0;
+                }
+
+                nodes[j] = n;
+                tokens[j] = tokens[i];
+                map[i] = j++;
+            }
+
+            nodes.resize(j);
+            tokens.resize(j);
+            constants = std::move(used_constants);
+            root = map[root];
 
-    struct lit : expr{
-        num_t value;
-        
-        constexpr evaluation_t evaluate() const {
-            return value;
+            if(hash_consing){
+                rehash(dedup.size());
+            }
         }
 
-        static constexpr expr_ptr_t literal(token&& t, num_t n){
-            return std::unique_ptr<lit>(
-                new lit(
-                    std::move(t), 
-                    n
-                )
-            );
+        // calls visit on every node reachable from the root, children
+        // first, lhs before rhs: the order the nodes are evaluated in. Stops
+        // when visit returns false. A node whose enter returns false is
+        // skipped with its children. The stack is on the heap, the depth of
+        // the tree doesn't matter
+        template<typename F, typename E>
+        constexpr void post_order(F visit, E enter) const {
+            // second is true once the children of the node have been pushed
+            std::vector<std::pair<node_idx, bool>> stack{{root, false}};
+
+            while(!stack.empty()){
+                const auto [i, expanded] = stack.back();
+                const auto& n = nodes[i];
+
+                if(!expanded && !enter(i)){
+                    stack.pop_back();
+                    continue;
+                }
+
+                if(expanded || n.op == OPCODE::LIT || n.op == OPCODE::VAR){
+                    stack.pop_back();
+                    if(!visit(i)){
+                        return;
+                    }
+                    continue;
+                }
+
+                stack.back().second = true;
+                if(is_binary(n.op)){
+                    stack.emplace_back(n.rhs, false);
+                }
+                stack.emplace_back(n.lhs, false);
+            }
         }
-        
-    private:
-        explicit constexpr lit(token&& t, num_t v) noexcept:
-            expr::expr(std::move(t)), 
-            value(v)
-        {}
     };
+
+    using ast = basic_ast<num_t>;
 }
 }
-#endif
\ No newline at end of file
+#endif
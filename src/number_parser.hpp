@@ -0,0 +1,547 @@
+#ifndef _MY_NUMBER_PARSER_
+#define _MY_NUMBER_PARSER_
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <string_view>
+
+#include "math_utils.hpp"
+#include "pow5_table.hpp"
+
+namespace calc{
+namespace{
+// decimal literals to the nearest double, ties to even, the same result as
+// std::from_chars but usable in constant evaluation. Three paths, from the
+// cheapest: an exact product of two doubles, the Eisel-Lemire algorithm for
+// mantissas of up to 19 digits and a big decimal for what the others can't
+// decide, which is rare
+namespace number_parser{
+
+    static_assert(std::numeric_limits<num_t>::is_iec559 && sizeof(num_t) == 8);
+
+    static constexpr int mantissa_bits = 52;
+    static constexpr int min_binary_exponent = -1023;
+    static constexpr int infinite_power = 0x7ff;
+
+    // the mantissa has the hidden bit cleared, power2 is the biased exponent
+    struct binary{
+        uint64_t mantissa = 0;
+        int32_t power2 = 0;
+
+        constexpr bool operator==(const binary&) const = default;
+    };
+
+    static constexpr binary infinity{0, infinite_power};
+
+    constexpr num_t to_double(binary b){
+        return std::bit_cast<num_t>(
+            b.mantissa | static_cast<uint64_t>(b.power2) << mantissa_bits
+        );
+    }
+
+    // literal split in digits and exponent, [0-9]*(.[0-9]+)?([eE][+-]?[0-9]+)?
+    struct decomposed{
+        // first 19 significant digits
+        uint64_t w = 0;
+        // value ~ w * 10^q
+        int64_t q = 0;
+        // some non zero digit didn't fit in w
+        bool truncated = false;
+        // all the digits, for the slow path
+        std::string_view integer;
+        std::string_view fraction;
+        int64_t exponent = 0;
+    };
+
+    constexpr bool is_digit(char c){
+        return c >= '0' && c <= '9';
+    }
+
+    constexpr std::optional<decomposed> decompose(std::string_view s){
+        decomposed ret;
+        const char* p = s.data();
+        const char* const end = p + s.size();
+
+        // significant digits seen, the ones past 19 only set truncated
+        size_t digits = 0;
+        const auto add = [&](char c){
+            if(digits < 19){
+                ret.w = ret.w * 10 + static_cast<uint64_t>(c - '0');
+                digits += ret.w != 0;
+                return true;
+            }
+
+            ret.truncated |= c != '0';
+            return false;
+        };
+
+        const char* const integer = p;
+        while(p != end && is_digit(*p)){
+            // the integer digits which don't fit scale w
+            ret.q += !add(*p);
+            ++p;
+        }
+        ret.integer = std::string_view(integer, static_cast<size_t>(p - integer));
+
+        if(p != end && *p == '.'){
+            const char* const fraction = ++p;
+            while(p != end && is_digit(*p)){
+                ret.q -= add(*p);
+                ++p;
+            }
+            ret.fraction = std::string_view(fraction, static_cast<size_t>(p - fraction));
+
+            if(ret.fraction.empty()){
+                return std::nullopt;
+            }
+        }
+
+        if(ret.integer.empty() && ret.fraction.empty()){
+            return std::nullopt;
+        }
+
+        if(p != end && (*p == 'e' || *p == 'E')){
+            ++p;
+            bool negative = false;
+            if(p != end && (*p == '+' || *p == '-')){
+                negative = *p == '-';
+                ++p;
+            }
+
+            if(p == end){
+                return std::nullopt;
+            }
+
+            for(; p != end && is_digit(*p); ++p){
+                // past this any literal is 0 or infinite
+                if(ret.exponent < 0x10000){
+                    ret.exponent = ret.exponent * 10 + (*p - '0');
+                }
+            }
+
+            if(negative){
+                ret.exponent = -ret.exponent;
+            }
+        }
+
+        if(p != end){
+            return std::nullopt;
+        }
+
+        // w * 10^q, q is the weight of the last digit in w
+        ret.q += ret.exponent;
+
+        return ret;
+    }
+
+    struct u128{
+        uint64_t high;
+        uint64_t low;
+    };
+
+    constexpr u128 full_multiplication(uint64_t a, uint64_t b){
+#ifdef __SIZEOF_INT128__
+        const auto r = static_cast<unsigned __int128>(a) * b;
+
+        return {static_cast<uint64_t>(r >> 64), static_cast<uint64_t>(r)};
+#else
+        const uint64_t a_lo = a & 0xffffffff, a_hi = a >> 32;
+        const uint64_t b_lo = b & 0xffffffff, b_hi = b >> 32;
+
+        const uint64_t lo_lo = a_lo * b_lo;
+        const uint64_t hi_lo = a_hi * b_lo;
+        const uint64_t lo_hi = a_lo * b_hi;
+        const uint64_t hi_hi = a_hi * b_hi;
+
+        const uint64_t cross = (lo_lo >> 32) + (hi_lo & 0xffffffff) + lo_hi;
+
+        return {hi_hi + (hi_lo >> 32) + (cross >> 32), (cross << 32) | (lo_lo & 0xffffffff)};
+#endif
+    }
+
+    // Clinger: w and 10^|q| are exact doubles, one rounding gives the answer
+    constexpr std::optional<num_t> clinger(uint64_t w, int64_t q){
+        constexpr std::array<num_t, 23> powers{
+            1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+            1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+        };
+
+        if(q < -22 || q > 22 || w > (uint64_t{1} << 53)){
+            return std::nullopt;
+        }
+
+        const auto v = static_cast<num_t>(w);
+
+        return q < 0 ?
+            v / powers[static_cast<size_t>(-q)] :
+            v * powers[static_cast<size_t>(q)];
+    }
+
+    // Eisel-Lemire: the nearest double to w * 10^q from a 128 bit
+    // approximation of 5^q. Exact when w holds every digit
+    constexpr binary eisel_lemire(uint64_t w, int64_t q){
+        if(w == 0 || q < pow5::min_exponent){
+            return {};
+        }
+        if(q > pow5::max_exponent){
+            return infinity;
+        }
+
+        const int lz = std::countl_zero(w);
+        w <<= lz;
+
+        const size_t index = 2 * static_cast<size_t>(q - pow5::min_exponent);
+
+        auto product = full_multiplication(w, pow5::table[index]);
+        // the low bits of the high half may be off by one, the next word
+        // of 5^q settles them
+        constexpr uint64_t precision_mask = ~uint64_t{0} >> (mantissa_bits + 3);
+        if((product.high & precision_mask) == precision_mask){
+            const auto second = full_multiplication(w, pow5::table[index + 1]);
+            product.low += second.high;
+            if(second.high > product.low){
+                ++product.high;
+            }
+        }
+
+        const int upperbit = static_cast<int>(product.high >> 63);
+        const int shift = upperbit + 64 - mantissa_bits - 3;
+
+        binary ret;
+        ret.mantissa = product.high >> shift;
+        // floor(q * log2(10)) + 63
+        const int32_t power = static_cast<int32_t>(((152170 + 65536) * q) >> 16) + 63;
+        ret.power2 = power + upperbit - lz - min_binary_exponent;
+
+        if(ret.power2 <= 0){
+            // subnormal
+            if(-ret.power2 + 1 >= 64){
+                return {};
+            }
+
+            ret.mantissa >>= -ret.power2 + 1;
+            ret.mantissa += ret.mantissa & 1;
+            ret.mantissa >>= 1;
+            ret.power2 = ret.mantissa < (uint64_t{1} << mantissa_bits) ? 0 : 1;
+
+            return ret;
+        }
+
+        // exactly halfway: only possible when 5^q is exact, ties go to even
+        if(product.low <= 1 && q >= -4 && q <= 23 && (ret.mantissa & 3) == 1 &&
+            (ret.mantissa << shift) == product.high
+        ){
+            ret.mantissa &= ~uint64_t{1};
+        }
+
+        ret.mantissa += ret.mantissa & 1;
+        ret.mantissa >>= 1;
+
+        if(ret.mantissa >= (uint64_t{2} << mantissa_bits)){
+            ret.mantissa = uint64_t{1} << mantissa_bits;
+            ++ret.power2;
+        }
+
+        ret.mantissa &= ~(uint64_t{1} << mantissa_bits);
+
+        if(ret.power2 >= infinite_power){
+            return infinity;
+        }
+
+        return ret;
+    }
+
+    // decimal with enough digits to tell any two halfway points apart,
+    // shifted by powers of two until it is a 53 bit integer
+    class big_decimal{
+        static constexpr size_t max_digits = 800;
+        static constexpr int32_t decimal_point_range = 2047;
+
+        std::array<uint8_t, max_digits> digits{};
+        size_t num_digits = 0;
+        // value = 0.digits * 10^decimal_point
+        int32_t decimal_point = 0;
+        // some non zero digit was dropped
+        bool truncated = false;
+
+    public:
+        constexpr big_decimal(const decomposed& d){
+            bool leading = true;
+
+            const auto add = [&](char c){
+                if(leading && c == '0'){
+                    --decimal_point;
+                    return;
+                }
+                leading = false;
+
+                if(num_digits < max_digits){
+                    digits[num_digits++] = static_cast<uint8_t>(c - '0');
+                }
+                else if(c != '0'){
+                    truncated = true;
+                }
+            };
+
+            decimal_point = static_cast<int32_t>(d.integer.size());
+            for(char c : d.integer){
+                add(c);
+            }
+            for(char c : d.fraction){
+                add(c);
+            }
+
+            decimal_point += static_cast<int32_t>(d.exponent);
+            trim();
+        }
+
+        constexpr binary to_binary(){
+            // shifts by which a number of decimal digits surely moves
+            constexpr std::array<uint32_t, 19> powers{
+                0, 3, 6, 9, 13, 16, 19, 23, 26, 29, 33, 36, 39, 43, 46, 49, 53, 56, 59,
+            };
+            constexpr uint32_t max_shift = 60;
+
+            const auto shift_for = [&](int32_t n){
+                return n < 19 ? powers[static_cast<size_t>(n)] : max_shift;
+            };
+
+            if(num_digits == 0 || decimal_point < -324){
+                return {};
+            }
+            if(decimal_point >= 310){
+                return infinity;
+            }
+
+            int32_t exp2 = 0;
+
+            while(decimal_point > 0){
+                const uint32_t shift = shift_for(decimal_point);
+                right_shift(shift);
+                if(decimal_point < -decimal_point_range){
+                    return {};
+                }
+                exp2 += static_cast<int32_t>(shift);
+            }
+
+            // until the value is in [1/2, 1)
+            while(decimal_point <= 0){
+                uint32_t shift;
+                if(decimal_point == 0){
+                    if(digits[0] >= 5){
+                        break;
+                    }
+                    shift = digits[0] < 2 ? 2 : 1;
+                }
+                else{
+                    shift = shift_for(-decimal_point);
+                }
+
+                left_shift(shift);
+                if(decimal_point > decimal_point_range){
+                    return infinity;
+                }
+                exp2 -= static_cast<int32_t>(shift);
+            }
+
+            // in [1, 2)
+            --exp2;
+
+            // subnormals
+            while(min_binary_exponent + 1 > exp2){
+                const uint32_t n = std::min<uint32_t>(
+                    static_cast<uint32_t>(min_binary_exponent + 1 - exp2),
+                    max_shift
+                );
+                right_shift(n);
+                exp2 += static_cast<int32_t>(n);
+            }
+
+            if(exp2 - min_binary_exponent >= infinite_power){
+                return infinity;
+            }
+
+            left_shift(mantissa_bits + 1);
+            uint64_t mantissa = round();
+
+            // rounding carried into a new bit
+            if(mantissa >= (uint64_t{2} << mantissa_bits)){
+                right_shift(1);
+                ++exp2;
+                mantissa = round();
+                if(exp2 - min_binary_exponent >= infinite_power){
+                    return infinity;
+                }
+            }
+
+            int32_t power2 = exp2 - min_binary_exponent;
+            if(mantissa < (uint64_t{1} << mantissa_bits)){
+                --power2;
+            }
+
+            return {mantissa & ((uint64_t{1} << mantissa_bits) - 1), power2};
+        }
+
+    private:
+        constexpr void trim(){
+            while(num_digits > 0 && digits[num_digits - 1] == 0){
+                --num_digits;
+            }
+        }
+
+        // integer part, rounded to nearest, ties to even
+        constexpr uint64_t round() const {
+            if(num_digits == 0 || decimal_point < 0){
+                return 0;
+            }
+            if(decimal_point > 18){
+                return UINT64_MAX;
+            }
+
+            const auto dp = static_cast<size_t>(decimal_point);
+            uint64_t n = 0;
+            for(size_t i = 0; i < dp; ++i){
+                n = n * 10 + (i < num_digits ? digits[i] : 0);
+            }
+
+            bool round_up = false;
+            if(dp < num_digits){
+                round_up = digits[dp] >= 5;
+                if(digits[dp] == 5 && dp + 1 == num_digits){
+                    round_up = truncated || (dp > 0 && digits[dp - 1] % 2 != 0);
+                }
+            }
+
+            return n + round_up;
+        }
+
+        // divides by 2^shift
+        constexpr void right_shift(uint32_t shift){
+            size_t read = 0;
+            size_t write = 0;
+            uint64_t n = 0;
+
+            while((n >> shift) == 0){
+                if(read < num_digits){
+                    n = n * 10 + digits[read++];
+                }
+                else if(n == 0){
+                    return;
+                }
+                else{
+                    while((n >> shift) == 0){
+                        n *= 10;
+                        ++read;
+                    }
+                    break;
+                }
+            }
+
+            decimal_point -= static_cast<int32_t>(read) - 1;
+            if(decimal_point < -decimal_point_range){
+                num_digits = 0;
+                decimal_point = 0;
+                truncated = false;
+                return;
+            }
+
+            const uint64_t mask = (uint64_t{1} << shift) - 1;
+            while(read < num_digits){
+                const auto digit = static_cast<uint8_t>(n >> shift);
+                n = 10 * (n & mask) + digits[read++];
+                digits[write++] = digit;
+            }
+            while(n > 0){
+                const auto digit = static_cast<uint8_t>(n >> shift);
+                n = 10 * (n & mask);
+                if(write < max_digits){
+                    digits[write++] = digit;
+                }
+                else if(digit > 0){
+                    truncated = true;
+                }
+            }
+
+            num_digits = write;
+            trim();
+        }
+
+        // multiplies by 2^shift, shift <= 60 so a digit and the carry fit
+        // in 64 bits
+        constexpr void left_shift(uint32_t shift){
+            if(num_digits == 0){
+                return;
+            }
+
+            // least significant digit first
+            std::array<uint8_t, max_digits + 20> out{};
+            size_t size = 0;
+            uint64_t carry = 0;
+
+            for(size_t i = num_digits; i-- > 0;){
+                const uint64_t n = (uint64_t{digits[i]} << shift) + carry;
+                out[size++] = static_cast<uint8_t>(n % 10);
+                carry = n / 10;
+            }
+            while(carry > 0){
+                out[size++] = static_cast<uint8_t>(carry % 10);
+                carry /= 10;
+            }
+
+            decimal_point += static_cast<int32_t>(size - num_digits);
+
+            // the lowest digits are dropped if they don't fit
+            const size_t dropped = size > max_digits ? size - max_digits : 0;
+            for(size_t i = 0; i < dropped; ++i){
+                truncated = truncated || out[i] != 0;
+            }
+
+            num_digits = size - dropped;
+            for(size_t i = 0; i < num_digits; ++i){
+                digits[i] = out[size - 1 - i];
+            }
+
+            trim();
+        }
+    };
+
+    // the literal, nullopt if it is malformed or too large for num_t
+    constexpr std::optional<num_t> parse(std::string_view s){
+        const auto d = decompose(s);
+        if(!d){
+            return std::nullopt;
+        }
+
+        binary b;
+
+        if(!d->truncated){
+            if(auto v = clinger(d->w, d->q)){
+                return v;
+            }
+
+            b = eisel_lemire(d->w, d->q);
+        }
+        else{
+            // the digits that didn't fit only matter when w and w + 1
+            // round differently
+            b = eisel_lemire(d->w, d->q);
+            if(b != eisel_lemire(d->w + 1, d->q)){
+                b = big_decimal(*d).to_binary();
+            }
+        }
+
+        if(b == infinity){
+            return std::nullopt;
+        }
+
+        return to_double(b);
+    }
+}
+}
+}
+
+#endif
@@ -0,0 +1,109 @@
+#ifndef _MY_OPERATORS_
+#define _MY_OPERATORS_
+
+#include <array>
+#include <cstdint>
+
+#include "kernels.hpp"
+
+namespace calc{
+namespace{
+// the operators of the grammar, read by the parser. Adding an operator is
+// adding a row here and its kernel
+namespace operators{
+    using TOKEN_TYPE = token_defs::TOKEN_TYPE;
+
+    enum class FIXITY : uint8_t{
+        PREFIX,
+        // prefix whose operand is a bracket: abs(...)
+        FUNCTION,
+        INFIX,
+        POSTFIX,
+    };
+
+    // no limit on what can follow
+    static constexpr uint8_t no_cap = UINT8_MAX;
+
+    struct operator_def{
+        TOKEN_TYPE token;
+        FIXITY fixity;
+        OPCODE op;
+        // infix and postfix: binding power on the left. Prefix: highest
+        // binding power of the context it can appear in
+        uint8_t lbp;
+        // binding power of the operand on the right
+        uint8_t rbp;
+        // only operators whose lbp is lower than cap can take the result
+        // as left operand: cap == lbp makes an operator non-associative,
+        // a prefix with a cap lower than a postfix binds looser than it
+        uint8_t cap;
+    };
+
+    /*
+        grammar encoded by the table:
+
+        EXPR: MUL_DIV (('+' MUL_DIV)? | ('-' MUL_DIV)?)
+        MUL_DIV: EXPONENT (('*' EXPONENT)? | ('/' EXPONENT)?)
+        EXPONENT: SIGN ('^' SIGN)?
+        SIGN: '-'? FACTORIAL
+        FACTORIAL: ATOM '!'?
+        ATOM: LIT | VAR | FUN? '(' EXPR ')'
+    */
+    static constexpr std::array table{
+        // left associative: the right operand can't contain the same level
+        operator_def{TOKEN_TYPE::PLUS, FIXITY::INFIX, OPCODE::ADD, 10, 11, 11},
+        operator_def{TOKEN_TYPE::MINUS, FIXITY::INFIX, OPCODE::SUB, 10, 11, 11},
+        operator_def{TOKEN_TYPE::ASTERISK, FIXITY::INFIX, OPCODE::MULT, 20, 21, 21},
+        operator_def{TOKEN_TYPE::SLASH, FIXITY::INFIX, OPCODE::DIV, 20, 21, 21},
+        // non associative, both operands are a SIGN
+        operator_def{TOKEN_TYPE::EXPONENT, FIXITY::INFIX, OPCODE::EXPONENT, 30, 40, 30},
+        // once, looser than '!'
+        operator_def{TOKEN_TYPE::MINUS, FIXITY::PREFIX, OPCODE::NEG, 40, 45, 40},
+        // once, right after an atom
+        operator_def{TOKEN_TYPE::FACTORIAL, FIXITY::POSTFIX, OPCODE::FACTORIAL, 50, 0, 40},
+        // the result is an atom
+        operator_def{TOKEN_TYPE::ABS, FIXITY::FUNCTION, OPCODE::ABS, no_cap, 60, no_cap},
+        operator_def{TOKEN_TYPE::FLOOR, FIXITY::FUNCTION, OPCODE::FLOOR, no_cap, 60, no_cap},
+        operator_def{TOKEN_TYPE::CEIL, FIXITY::FUNCTION, OPCODE::CEIL, no_cap, 60, no_cap},
+    };
+
+    static constexpr size_t token_types = static_cast<size_t>(TOKEN_TYPE::VAR) + 1;
+
+    // index in the table of the operator of each token, one per position
+    consteval std::array<uint8_t, token_types> index(bool prefix){
+        std::array<uint8_t, token_types> ret{};
+        ret.fill(UINT8_MAX);
+
+        for(size_t i = 0; i < table.size(); ++i){
+            const bool is_prefix = table[i].fixity == FIXITY::PREFIX ||
+                table[i].fixity == FIXITY::FUNCTION;
+
+            if(is_prefix == prefix){
+                ret[static_cast<size_t>(table[i].token)] = static_cast<uint8_t>(i);
+            }
+        }
+
+        return ret;
+    }
+
+    static constexpr auto prefix_index = index(true);
+    static constexpr auto infix_index = index(false);
+
+    // operator at the beginning of an operand
+    constexpr const operator_def* prefix(TOKEN_TYPE t){
+        const auto i = prefix_index[static_cast<size_t>(t)];
+
+        return i == UINT8_MAX ? nullptr : &table[i];
+    }
+
+    // operator after an operand
+    constexpr const operator_def* infix(TOKEN_TYPE t){
+        const auto i = infix_index[static_cast<size_t>(t)];
+
+        return i == UINT8_MAX ? nullptr : &table[i];
+    }
+}
+}
+}
+
+#endif
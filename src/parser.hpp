@@ -6,38 +6,187 @@
 #include <expected>
 #include <type_traits>
 #include <functional>
+#include <charconv>
 #include <cmath>
+#include <cstdint>
 #include <functional>
+#include <span>
+#include <vector>
 
 #include "tokenizer.hpp"
 #include "math_utils.hpp"
+#include "number_parser.hpp"
 #include "nodes.hpp"
+#include "operators.hpp"
+#include "batch.hpp"
+#include "limits.hpp"
 
 /*
-    EXPR: MUL_DIV (('+' MUL_DIV)? | ('-' MUL_DIV)?)
-    MUL_DIV: EXPONENT (('*' EXPONENT)? | ('/' EXPONENT)?)
-    EXPONENT: SIGN ('^' SIGN)?
-    SIGN: '-'? FACTORIAL
-    FACTORIAL: ATOM '!'?
-    ATOM: LIT | FUN? '(' EXPR ')'
-    FUN: abs // SIN, LOG, ...
-    LIT: int | double
+    operators and their precedence: see operators.hpp
+    FUN: abs | floor | ceil // SIN, LOG, ...
+    LIT: int | double, with an optional exponent: 1.5e-3
+    VAR: [a-zA-Z_][a-zA-Z0-9_]* which is not a FUN
 */
 
 namespace calc{
 namespace {
+
+    // parsed expression which can be evaluated any number of times: it owns
+    // both the tree and the buffer its tokens and errors refer to. The
+    // buffer is on the heap, it doesn't move when the expression does. The
+    // tree is also lowered to bytecode, which is what evaluate() runs
+    template<number T>
+    class basic_compiled_expression{
+
+        std::vector<char> expr;
+        basic_ast<T> tree;
+        basic_program<T> prog;
+        // variable names, the position of a name is its slot
+        std::vector<std::string> vars;
+        // of each evaluation, see limits::steps
+        size_t steps;
+
+    public:
+        constexpr basic_compiled_expression(
+            std::vector<char>&& e, 
+            basic_ast<T>&& a, 
+            std::vector<std::string>&& v,
+            size_t s = SIZE_MAX
+        ):
+            expr(std::move(e)),
+            tree(std::move(a)),
+            vars(std::move(v)),
+            steps(s)
+        {
+            tree.lower(prog);
+        }
+
+        constexpr basic_compiled_expression(basic_compiled_expression&&) noexcept = default;
+        constexpr basic_compiled_expression& operator=(basic_compiled_expression&&) noexcept = default;
+
+        // values[i] is the value of the variable in slot i
+        constexpr basic_evaluation_t<T> evaluate(std::span<const T> values = {}) const {
+            return prog.run(expression(), values, steps);
+        }
+
+        constexpr basic_evaluation_t<T> evaluate(std::initializer_list<T> values) const {
+            return evaluate(std::span(values.begin(), values.size()));
+        }
+
+        // evaluates every row of the input: columns[i] holds the values of
+        // the variable in slot i, one per row. out[r] and errors[r] get the
+        // outcome of row r, failed rows are NaN (0 for integers). The
+        // returned error is for the whole batch, e.g. a missing column
+        constexpr std::optional<calc_err> evaluate_batch(
+            std::span<const std::span<const T>> columns,
+            std::span<T> out,
+            std::span<lane_err> errors
+        ) const {
+            return batch::run(prog, expression(), columns, out, errors);
+        }
+
+        // same as above, the rows are split among the threads of pool
+        std::optional<calc_err> evaluate_batch(
+            std::span<const std::span<const T>> columns,
+            std::span<T> out,
+            std::span<lane_err> errors,
+            thread_pool& pool
+        ) const {
+            return batch::run_parallel(prog, expression(), columns, out, errors, pool);
+        }
+
+        // same result as evaluate(), walking the tree instead of running the
+        // bytecode
+        constexpr basic_evaluation_t<T> evaluate_tree(std::span<const T> values = {}) const {
+            return tree.evaluate(expression(), values, steps);
+        }
+
+        // optional optimisation pass, meant for expressions evaluated many
+        // times. Results and errors don't change. Returns how many nodes were
+        // removed from the tree
+        constexpr size_t simplify(){
+            const size_t removed = tree.simplify(expression());
+
+            prog = basic_program<T>{};
+            tree.lower(prog);
+
+            return removed;
+        }
+
+        // optional pass merging the identical subtrees, each is then
+        // computed once per evaluation. Results and errors don't change,
+        // an error is reported on the first occurrence. Returns how many
+        // nodes were merged
+        constexpr size_t deduplicate(){
+            const size_t merged = tree.deduplicate();
+
+            prog = basic_program<T>{};
+            tree.lower(prog);
+
+            return merged;
+        }
+
+        constexpr const basic_ast<T>& syntax_tree() const {
+            return tree;
+        }
+
+        constexpr const basic_program<T>& bytecode() const {
+            return prog;
+        }
+
+        // see limits::steps, SIZE_MAX without a limit
+        constexpr size_t step_limit() const {
+            return steps;
+        }
+
+        constexpr std::string_view expression() const {
+            return std::string_view(expr.data(), expr.size());
+        }
+
+        constexpr std::span<const std::string> variables() const {
+            return vars;
+        }
+
+        // meant to be called once, not on the evaluation path
+        constexpr std::optional<size_t> slot(std::string_view name) const {
+            auto it = std::find(std::begin(vars), std::end(vars), name);
+            if(it == std::end(vars)){
+                return std::nullopt;
+            }
+
+            return static_cast<size_t>(std::distance(std::begin(vars), it));
+        }
+    };
     
-    class parser{
-        
-        expr_ptr_t root;
+    template<number T>
+    class basic_parser{
+
+        using TOKEN_TYPE = tokenizer::TOKEN_TYPE;
+
+        basic_ast<T> tree;
         tokenizer t;
-        std::string expr;
+        // the input, tokens and nodes refer to it by offset. It is never
+        // copied, so errors point into the caller's string
+        std::string_view expr;
+        // variable names in slot order
+        std::vector<std::string> vars;
+        // when set, only the names already in vars are accepted
+        bool declared_vars = false;
+        limits lim;
 
     public:
-        constexpr parser() = default;
+        constexpr basic_parser() = default;
 
-        constexpr std::expected<num_t, calc_err> evaluate(std::string_view str){
-            using enum calc_err_type_t;
+        // every expression parsed, evaluated or compiled is held to l
+        constexpr explicit basic_parser(const limits& l):
+            lim(l)
+        {}
+
+        // one-shot evaluation walks the tree, lowering wouldn't pay off.
+        // An error refers to str, which must outlive it
+        constexpr basic_evaluation_t<T> evaluate(std::string_view str){
+            vars.clear();
+            declared_vars = false;
 
             auto err = parse(str);
 
@@ -45,340 +194,392 @@ namespace {
                 return std::unexpected(*err);
             }
 
-            assert(root != nullptr);
-            
-            return root->evaluate();
+            return tree.evaluate(expr, {}, budget(lim.steps));
+        }
+
+        // variables get their slot in order of first appearance.
+        // The parser is left empty: the tree and the buffer are moved out
+        constexpr std::expected<basic_compiled_expression<T>, calc_err> compile(std::string_view str){
+            vars.clear();
+            declared_vars = false;
+
+            return build(str);
+        }
+
+        // the slot of each variable is its position in names, other names
+        // are rejected
+        constexpr std::expected<basic_compiled_expression<T>, calc_err> compile(
+            std::string_view str, 
+            std::span<const std::string_view> names
+        ){
+            vars.assign(std::begin(names), std::end(names));
+            declared_vars = true;
+
+            return build(str);
         }
 
     private:
+        constexpr std::expected<basic_compiled_expression<T>, calc_err> build(std::string_view str){
+            // the compiled expression and its errors refer to its own copy
+            std::vector<char> buf(std::begin(str), std::end(str));
+
+            auto err = parse(std::string_view(buf.data(), buf.size()));
+
+            if(err){
+                // still pointing into buf
+                return std::unexpected(relocate(*err, str));
+            }
+
+            return basic_compiled_expression<T>(
+                std::move(buf), 
+                std::move(tree), 
+                std::move(vars), 
+                budget(lim.steps)
+            );
+        }
+
+        // the same error, referring to str instead
+        static constexpr calc_err relocate(const calc_err& err, std::string_view str){
+            if(!err.get_start()){
+                return err;
+            }
+
+            return calc_err::error_with_wrong_token(
+                err.get_err_type(),
+                err.get_err_msg().data(),
+                str,
+                *err.get_start(),
+                *err.get_end()
+            );
+        }
+
         constexpr std::optional<calc_err> parse(std::string_view input){
             using enum calc_err_type_t;
 
-            root.reset();
+            tree.clear();
 
-            expr = std::string{input};
-            auto new_end = std::unique(std::begin(expr), std::end(expr), 
-                [](char c1, char c2){
-                    return c1 == c2 && (c1 == ' ' || c1 == '\t');
-                }
-            );
-            expr.erase(new_end, std::end(expr));
+            expr = input;
 
+            // the part past the limit is the span
+            if(input.size() > budget(lim.length)){
+                return calc_err::error_with_wrong_token(
+                    LIMIT_EXCEEDED, 
+                    "Expression too long, limit exceeded",
+                    expr,
+                    lim.length,
+                    expr.size()
+                );
+            }
 
-            auto err = t.tokenize(expr);
+            auto err = t.tokenize(expr, budget(lim.tokens));
             if(err){
                 return err;
             }
 
             auto tmp = parse_exp();
+            const bool trailing = tmp && t.has_more_tokens();
+
+            // the parser stops as soon as it reaches a symbol the tokenizer
+            // couldn't recognise, that is the error to report
+            if(t.error()){
+                return t.error();
+            }
+
             if(!tmp){
                 return tmp.error();
             }
 
-            if(t.has_more_tokens()){
+            if(trailing){
                 auto tok = t.next();
                 return calc_err::error_with_wrong_token(
                     UNEXPECTED_TOKEN, 
                     "Unexpected token after end-of-expression",
-                    tok->full_expr,
+                    expr,
                     tok->start,
                     tok->end
                 );
             }
 
-            root = std::move(*tmp);
+            tree.root = *tmp;
 
             return std::nullopt;
         }
 
-        constexpr std::expected<expr_ptr_t, calc_err> parse_exp(){
-
-            auto next_expr = parse_mul_div();
-            if(!next_expr){
-                return next_expr;
-            }
-            
-            while(t.match(tokenizer::TOKEN_TYPE::PLUS) || 
-                t.match(tokenizer::TOKEN_TYPE::MINUS)
-            ){
-                auto next = t.next();
-
-                auto next_expr_2 = parse_mul_div();
-                if(!next_expr_2){
-                    return next_expr_2;
-                }
+        // operator waiting for its right operand, which is being parsed.
+        // A bracket waits for its ')' and the root for nothing. Deep nesting
+        // only grows the stack on the heap
+        struct frame{
+            // nullptr for a bracket and the root
+            const operators::operator_def* op = nullptr;
+            // of op or of the open bracket
+            std::optional<token> tok = std::nullopt;
+            // left operand of op
+            node_idx left = 0;
+            // the operand parsed so far
+            node_idx lhs = 0;
+            // only operators binding at least this much belong to the operand
+            uint8_t min_bp = 0;
+            // see operator_def::cap, set by the last operator applied to lhs
+            uint8_t cap = operators::no_cap;
+        };
+
+        // precedence climbing driven by the operator table: the grammar is
+        // the binding powers, not the code
+        constexpr std::expected<node_idx, calc_err> parse_exp(){
+            using enum calc_err_type_t;
+            using operators::FIXITY;
 
-                if(next->type == tokenizer::TOKEN_TYPE::PLUS){
-                    next_expr = binary_op::add(
-                        std::move(*next),
-                        std::move(*next_expr), 
-                        std::move(*next_expr_2)
-                    );    
-                }
-                else{
-                    next_expr = binary_op::sub(
-                        std::move(*next),
-                        std::move(*next_expr), 
-                        std::move(*next_expr_2)
-                    );  
-                }
-            }
+            std::vector<frame> stack{frame{}};
+            // the next token begins an operand, otherwise it follows one
+            bool operand = true;
 
-            return next_expr;
-        }
+            // every frame but the root waits for its operand
+            const size_t max_depth = budget(lim.depth);
+            const auto too_deep = [&](const token& tok){
+                return std::unexpected(
+                    calc_err::error_with_wrong_token(
+                        LIMIT_EXCEEDED, 
+                        "Nesting too deep, limit exceeded", 
+                        expr, 
+                        tok.start, 
+                        tok.end
+                    )
+                );
+            };
+
+            while(true){
+                // not valid anymore after a push
+                auto& f = stack.back();
+
+                if(operand){
+                    auto tok = t.next();
+                    if(!tok){
+                        return std::unexpected(
+                            calc_err::error_with_wrong_token(
+                                EXPECTED_TOKEN, 
+                                "Expected token, found end-of-expression instead", 
+                                expr,
+                                expr.size() - 1, 
+                                expr.size()
+                            )
+                        );
+                    }
 
-        constexpr std::expected<expr_ptr_t, calc_err> parse_mul_div(){
+                    const auto* op = operators::prefix(tok->type);
+                    const bool opens = (op && op->lbp >= f.min_bp) || tok->type == TOKEN_TYPE::OPEN_PAR;
 
-            auto next_expr = parse_exponent();
-            if(!next_expr){
-                return next_expr;
-            }
-            
-            while(t.match(tokenizer::TOKEN_TYPE::ASTERISK) || 
-                t.match(tokenizer::TOKEN_TYPE::SLASH)
-            ){
-                auto next = t.next();
-
-                auto next_expr_2 = parse_exponent();
-                if(!next_expr_2){
-                    return next_expr_2;
-                }
+                    if(opens && stack.size() > max_depth){
+                        return too_deep(*tok);
+                    }
 
-                if(next->type == tokenizer::TOKEN_TYPE::ASTERISK){
-                    next_expr = binary_op::mult(
-                        std::move(*next),
-                        std::move(*next_expr), 
-                        std::move(*next_expr_2)
-                    ); 
-                }
-                else{
-                    next_expr = binary_op::div(
-                        std::move(*next),
-                        std::move(*next_expr), 
-                        std::move(*next_expr_2)
-                    ); 
-                }
-            }
+                    if(op && op->lbp >= f.min_bp){
+                        if(op->fixity == FIXITY::FUNCTION && !t.match(TOKEN_TYPE::OPEN_PAR)){
+                            return std::unexpected(
+                                calc_err::error_with_wrong_token(
+                                    EXPECTED_TOKEN, 
+                                    "Expected an open bracket '(' after function call", 
+                                    expr, 
+                                    tok->start, 
+                                    tok->end
+                                )
+                            );
+                        }
 
-            return next_expr;
-        }
+                        stack.push_back({op, std::move(tok), 0, 0, op->rbp});
+                    }
+                    else if(tok->type == TOKEN_TYPE::OPEN_PAR){
+                        stack.push_back({nullptr, std::move(tok)});
+                    }
+                    else{
+                        auto leaf = parse_leaf(std::move(*tok));
+                        if(!leaf){
+                            return leaf;
+                        }
 
-        constexpr std::expected<expr_ptr_t, calc_err> parse_exponent(){
-            auto next_expr = parse_sign();
-            if(!next_expr){
-                return next_expr;
-            }
-            
-            if(t.match(tokenizer::TOKEN_TYPE::EXPONENT)){
-                auto next = t.next();
+                        f.lhs = *leaf;
+                        f.cap = operators::no_cap;
+                        operand = false;
+                    }
 
-                auto next_expr_2 = parse_sign();
-                if(!next_expr_2){
-                    return next_expr_2;
+                    continue;
                 }
 
-                return binary_op::exponent(
-                    std::move(*next),
-                    std::move(*next_expr), 
-                    std::move(*next_expr_2)
-                );
-               
-            }
-
-            return next_expr;
-        }
-
-        constexpr std::expected<expr_ptr_t, calc_err> parse_sign(){
+                const auto next = t.peek();
+                const auto* op = next ? operators::infix(next->type) : nullptr;
 
-            bool is_pos = true;
-            std::optional<token> next;
+                if(op && op->lbp >= f.min_bp && op->lbp < f.cap){
+                    auto tok = t.next();
 
-            if(t.match(tokenizer::TOKEN_TYPE::MINUS)){
-                next = t.next();
-                is_pos = false;
-            }
-            
-            auto next_expr = parse_factorial();
-            if(!next_expr || is_pos){
-                return next_expr;
-            }
-            
-            return unary_op::neg(
-                std::move(*next),
-                std::move(*next_expr)
-            );
-        }
-        
-        constexpr std::expected<expr_ptr_t, calc_err> parse_factorial(){
-            
-            auto next_expr = parse_atom();
-            if(!next_expr){
-                return next_expr;
-            }
-
-            if(t.match(tokenizer::TOKEN_TYPE::FACTORIAL)){
-                return unary_op::factorial(
-                    std::move(*t.next()),
-                    std::move(*next_expr)
-                );
-            }
-            
-            return next_expr;
-        }
-
-        constexpr std::expected<expr_ptr_t, calc_err> parse_atom(){
-            using enum calc_err_type_t;
-
-            std::expected<expr_ptr_t, calc_err> tmp;
-            std::optional<num_t> lit_val;
+                    if(op->fixity == FIXITY::POSTFIX){
+                        f.lhs = tree.unary(op->op, std::move(*tok), f.lhs);
+                        f.cap = op->cap;
+                    }
+                    else{
+                        if(stack.size() > max_depth){
+                            return too_deep(*tok);
+                        }
 
-            auto tok = t.next();
+                        stack.push_back({op, std::move(tok), f.lhs, 0, op->rbp});
+                        operand = true;
+                    }
 
-            if(!tok){
-                return std::unexpected(
-                    calc_err::error_with_wrong_token(
-                        EXPECTED_TOKEN, 
-                        "Expected token, found end-of-expression instead", 
-                        expr,
-                        expr.size() - 1, 
-                        expr.size()
-                    )
-                );
-            }
-            
-            switch (tok->type){
-            case tokenizer::TOKEN_TYPE::ABS: [[fallthrough]];
-            case tokenizer::TOKEN_TYPE::CEIL: [[fallthrough]];
-            case tokenizer::TOKEN_TYPE::FLOOR:
-                if(!t.match(tokenizer::TOKEN_TYPE::OPEN_PAR)){
-                    return std::unexpected(
-                        calc_err::error_with_wrong_token(
-                            EXPECTED_TOKEN, 
-                            "Expected an open bracket '(' after function call", 
-                            tok->full_expr, 
-                            tok->start, 
-                            tok->end
-                        )
-                    );
+                    continue;
                 }
 
-                tmp = parse_atom();
-                if(!tmp){
-                    return tmp;
+                // the operand of f is complete
+                if(stack.size() == 1){
+                    return f.lhs;
                 }
 
-                if(tok->type == tokenizer::TOKEN_TYPE::ABS){
-                    tmp = unary_op::abs(std::move(*tok), std::move(*tmp));
+                node_idx ret = f.lhs;
+                uint8_t cap = operators::no_cap;
+
+                if(!f.op){
+                    if(!t.consume(TOKEN_TYPE::CLOSED_PAR)){
+                        return std::unexpected(
+                            calc_err::error_with_wrong_token(
+                                EXPECTED_TOKEN, 
+                                "Expected a closed bracket ')'", 
+                                expr, 
+                                f.tok->start, 
+                                f.tok->end
+                            )
+                        );
+                    }
                 }
-                else if(tok->type == tokenizer::TOKEN_TYPE::FLOOR){
-                    tmp = unary_op::floor(std::move(*tok), std::move(*tmp));
+                else if(f.op->fixity == FIXITY::INFIX){
+                    ret = tree.binary(f.op->op, std::move(*f.tok), f.left, f.lhs);
+                    cap = f.op->cap;
                 }
-                else if(tok->type == tokenizer::TOKEN_TYPE::CEIL){
-                    tmp = unary_op::ceil(std::move(*tok), std::move(*tmp));
+                else{
+                    ret = tree.unary(f.op->op, std::move(*f.tok), f.lhs);
+                    cap = f.op->cap;
                 }
 
-                break;
+                stack.pop_back();
+                stack.back().lhs = ret;
+                stack.back().cap = cap;
+            }
+        }
 
-            case tokenizer::TOKEN_TYPE::OPEN_PAR:
-                tmp = parse_exp();
-                if(!tmp){
-                    return tmp;
-                }
+        // LIT | VAR, anything else can't begin an operand
+        constexpr std::expected<node_idx, calc_err> parse_leaf(token&& tok){
+            using enum calc_err_type_t;
+
+            std::optional<T> lit_val;
+            std::optional<size_t> slot;
 
-                if(!t.consume(tokenizer::TOKEN_TYPE::CLOSED_PAR)){
+            switch (tok.type){
+            case TOKEN_TYPE::LIT:
+                lit_val = lit_convert(tok.text(expr));
+                if(!lit_val){
                     return std::unexpected(
                         calc_err::error_with_wrong_token(
-                            EXPECTED_TOKEN, 
-                            "Expected a closed bracket ')'", 
-                            tok->full_expr, 
-                            tok->start, 
-                            tok->end
+                            INVALID_LITERAL, 
+                            "Invalid literal", 
+                            expr, 
+                            tok.start, 
+                            tok.end
                         )
                     );
                 }
-                break;
 
-            case tokenizer::TOKEN_TYPE::LIT:
-                lit_val = lit_convert(tok->full_expr.substr(tok->start, tok->end - tok->start));
-                if(!lit_val){
+                return tree.literal(std::move(tok), *lit_val);
+
+            case TOKEN_TYPE::VAR:
+                slot = var_slot(tok.text(expr));
+                if(!slot){
                     return std::unexpected(
                         calc_err::error_with_wrong_token(
-                            INVALID_LITERAL, 
-                            "Invalid literal", 
-                            tok->full_expr, 
-                            tok->start, 
-                            tok->end
+                            UNKNOWN_VARIABLE, 
+                            "Unknown variable", 
+                            expr, 
+                            tok.start, 
+                            tok.end
                         )
                     );
                 }
 
-                tmp = lit::literal(std::move(*tok), *lit_val);
-                
-                break;
-
-            // sin, cos, ...
+                return tree.variable(std::move(tok), *slot);
 
             default:
                 return std::unexpected(
                     calc_err::error_with_wrong_token(
                         INVALID_EXPR, 
                         "Invalid expression, expected a literal or function", 
-                        tok->full_expr, 
-                        tok->start, 
-                        tok->end
+                        expr, 
+                        tok.start, 
+                        tok.end
                     )
                 );
             }
-
-            return tmp;
         }
 
-        constexpr std::optional<num_t> lit_convert(std::string_view n){
-
-            // string to num_t
-            constexpr auto ston = 
-                [](auto start, const auto end) -> std::optional<num_t> {
+        // slots are resolved here once, evaluation only indexes the values
+        constexpr std::optional<size_t> var_slot(std::string_view name){
+            auto it = std::find(std::begin(vars), std::end(vars), name);
+            if(it != std::end(vars)){
+                return static_cast<size_t>(std::distance(std::begin(vars), it));
+            }
 
-                    num_t ret = 0;
-                    while(start != end){
+            if(declared_vars){
+                return std::nullopt;
+            }
 
-                        if(!(*start >= '0' && *start <= '9')){
-                            return std::nullopt;
-                        }
+            vars.emplace_back(name);
 
-                        ret = ret * 10 + static_cast<num_t>(*start - '0');
+            return vars.size() - 1;
+        }
 
-                        ++start;
+        // correctly rounded for double, nullopt if the literal is too large.
+        // Narrower types round the double, which can differ from rounding
+        // the decimal once. Wider ones are parsed by the standard library,
+        // constant evaluation only has the double. Integers take digits only
+        static constexpr std::optional<T> lit_convert(std::string_view n){
+            if constexpr(std::integral<T>){
+                T ret = 0;
+                for(const char c : n){
+                    if(c < '0' || c > '9' ||
+                        __builtin_mul_overflow(ret, 10, &ret) ||
+                        __builtin_add_overflow(ret, c - '0', &ret)
+                    ){
+                        return std::nullopt;
                     }
+                }
 
-                    return ret;
-                };
-
-            if(n.size() == 0 || n.size() > 20){
-                return std::nullopt;
+                return ret;
             }
+            else{
+                if constexpr(sizeof(T) > sizeof(double)){
+                    if !consteval{
+                        T ret{};
+                        const auto [end, ec] = std::from_chars(n.data(), n.data() + n.size(), ret);
+                        if(ec != std::errc{} || end != n.data() + n.size()){
+                            return std::nullopt;
+                        }
 
-            auto decimal_point = std::find(std::begin(n), std::end(n), '.');
+                        return ret;
+                    }
+                }
 
-            auto numerator_opt = ston(std::begin(n), decimal_point);
-            if(!numerator_opt || decimal_point == std::end(n)){
-                return numerator_opt;
-            }
+                const auto d = number_parser::parse(n);
+                if(!d){
+                    return std::nullopt;
+                }
 
-            ++decimal_point; // go to the first decimal digit            
-            num_t div = static_cast<num_t>(
-                std::distance(decimal_point, std::end(n))
-            );
-            
-            auto denom_opt = ston(decimal_point, std::end(n));
-            if(!denom_opt){
-                return denom_opt;
-            }
+                const auto ret = static_cast<T>(*d);
+                if(!std::isfinite(ret)){
+                    return std::nullopt;
+                }
 
-            return *numerator_opt + *denom_opt / std::pow(10., div);
+                return ret;
+            }
         }
 
     };
+
+    using compiled_expression = basic_compiled_expression<num_t>;
+    using parser = basic_parser<num_t>;
 }
 
 }
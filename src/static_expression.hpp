@@ -0,0 +1,189 @@
+#ifndef _MY_STATIC_EXPRESSION_
+#define _MY_STATIC_EXPRESSION_
+
+#include <algorithm>
+#include <array>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string_view>
+
+#include "parser.hpp"
+
+namespace calc{
+namespace{
+
+    // string literal usable as template argument
+    template<size_t N>
+    struct fixed_string{
+        std::array<char, N> data{};
+
+        constexpr fixed_string(const char (&s)[N]){
+            std::copy_n(s, N, std::begin(data));
+        }
+
+        constexpr fixed_string(const std::array<char, N>& s):
+            data(s)
+        {}
+
+        constexpr std::string_view view() const {
+            return std::string_view(data.data());
+        }
+    };
+
+    template<auto...>
+    inline constexpr bool always_false = false;
+
+    // instantiated when the expression given to compile<>() is invalid:
+    // the compiler reports the message and the span [start, end) of the
+    // error as template arguments of this type
+    template<fixed_string message, size_t start, size_t end>
+    struct syntax_error{
+        static_assert(always_false<message, start, end>,
+            "invalid expression, see the message and span of calc::syntax_error"
+        );
+    };
+
+    // expression parsed during compilation. The tree is a constant, every
+    // node is expanded in place by the templates below so the optimiser sees
+    // straight-line code, with the same checks as compiled_expression
+    template<fixed_string str>
+    class static_expression{
+
+        struct sizes{
+            std::optional<calc_err> err;
+            size_t nodes = 0;
+            size_t constants = 0;
+            size_t vars = 0;
+        };
+
+        // not simplified: constant evaluation rejects the overflows folding
+        // may run into, the optimiser folds the constants anyway
+        static constexpr std::expected<compiled_expression, calc_err> parse(){
+            return parser().compile(str.view());
+        }
+
+        static constexpr sizes info = []{
+            auto c = parse();
+            if(!c){
+                return sizes{c.error()};
+            }
+
+            return sizes{
+                std::nullopt,
+                c->syntax_tree().nodes.size(),
+                c->syntax_tree().constants.size(),
+                c->variables().size(),
+            };
+        }();
+
+        // the tree can't leave constant evaluation as it is, it is copied
+        // into arrays of the right size
+        struct static_tree{
+            std::array<node, info.nodes> nodes{};
+            std::array<token, info.nodes> tokens{};
+            std::array<num_t, info.constants> constants{};
+            // see ast::exact_values()
+            std::array<std::optional<int64_t>, info.nodes> exact{};
+            // offsets of the variable names in str
+            std::array<std::pair<size_t, size_t>, info.vars> vars{};
+            node_idx root = 0;
+        };
+
+        static constexpr static_tree tree = []{
+            static_tree ret;
+
+            auto c = parse();
+            if(!c){
+                return ret;
+            }
+
+            const auto& t = c->syntax_tree();
+
+            std::ranges::copy(t.nodes, std::begin(ret.nodes));
+            std::ranges::copy(t.tokens, std::begin(ret.tokens));
+            std::ranges::copy(t.constants, std::begin(ret.constants));
+            std::ranges::copy(t.exact_values(), std::begin(ret.exact));
+            ret.root = t.root;
+
+            for(size_t i = 0; i < info.vars; ++i){
+                const auto pos = str.view().find(c->variables()[i]);
+                ret.vars[i] = {pos, c->variables()[i].size()};
+            }
+
+            return ret;
+        }();
+
+        // the tokens and the errors refer to the template argument
+        static constexpr std::string_view expr(){
+            return str.view();
+        }
+
+        template<node_idx i>
+        static constexpr evaluation_t eval(std::span<const num_t, info.vars> values){
+            constexpr node n = tree.nodes[i];
+
+            if constexpr(n.op == OPCODE::LIT){
+                return tree.constants[n.lhs];
+            }
+            else if constexpr(tree.exact[i].has_value()){
+                return static_cast<num_t>(*tree.exact[i]);
+            }
+            else if constexpr(n.op == OPCODE::VAR){
+                return values[n.lhs];
+            }
+            else{
+                auto a = eval<n.lhs>(values);
+                if(!a){
+                    return a;
+                }
+
+                if constexpr(is_binary(n.op)){
+                    auto b = eval<n.rhs>(values);
+                    if(!b){
+                        return b;
+                    }
+
+                    return kernels::apply(n.op, *a, *b, tree.tokens[i], expr());
+                }
+                else{
+                    return kernels::apply(n.op, *a, tree.tokens[i], expr());
+                }
+            }
+        }
+
+    public:
+        // variables in slot order, which is the order of first appearance
+        static constexpr auto variables = []{
+            std::array<std::string_view, info.vars> ret{};
+
+            for(size_t i = 0; i < info.vars; ++i){
+                ret[i] = str.view().substr(tree.vars[i].first, tree.vars[i].second);
+            }
+
+            return ret;
+        }();
+
+        static constexpr std::optional<calc_err> error(){
+            return info.err;
+        }
+
+        // one value per variable, in slot order
+        template<typename... Ts>
+        requires (sizeof...(Ts) == info.vars && (std::convertible_to<Ts, num_t> && ...))
+        constexpr evaluation_t operator()(Ts... values) const {
+            const std::array<num_t, info.vars> v{static_cast<num_t>(values)...};
+
+            return eval<tree.root>(v);
+        }
+
+        constexpr evaluation_t operator()(std::span<const num_t, info.vars> values) const {
+            return eval<tree.root>(values);
+        }
+    };
+}
+}
+
+#endif
@@ -0,0 +1,136 @@
+#ifndef _MY_THREAD_POOL_
+#define _MY_THREAD_POOL_
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace calc{
+namespace{
+
+    // fixed set of workers running one parallel loop at a time. Work is
+    // split in chunks which every thread, the caller included, takes from a
+    // shared counter until none is left: a thread that finishes early keeps
+    // taking the chunks the slower ones didn't reach
+    class thread_pool{
+
+        std::vector<std::jthread> workers;
+
+        // one loop at a time
+        std::mutex running_loop;
+
+        std::mutex m;
+        std::condition_variable_any start;
+        std::condition_variable done;
+        // bumped for every loop, workers wait for it to change
+        size_t generation = 0;
+        size_t busy = 0;
+
+        // current loop, written before the workers are woken up
+        std::function<void(size_t, size_t)> job;
+        size_t chunks = 0;
+        std::atomic<size_t> next_chunk = 0;
+        // the first exception thrown by the current loop
+        std::exception_ptr failure;
+
+    public:
+        // threads counts the caller too
+        explicit thread_pool(size_t threads = std::thread::hardware_concurrency()){
+            threads = std::max<size_t>(threads, 1);
+
+            for(size_t i = 1; i < threads; ++i){
+                workers.emplace_back([this, i](std::stop_token stop){
+                    work(stop, i);
+                });
+            }
+        }
+
+        thread_pool(const thread_pool&) = delete;
+        thread_pool& operator=(const thread_pool&) = delete;
+
+        // stops and joins the workers while the rest is still alive
+        ~thread_pool(){
+            workers.clear();
+        }
+
+        size_t size() const {
+            return workers.size() + 1;
+        }
+
+        // calls f(thread, chunk) for every chunk in [0, n) and returns when
+        // all of them are done. thread is in [0, size()), no two calls with
+        // the same thread run at the same time. An exception thrown by f
+        // skips the chunks not started yet and is rethrown here once the
+        // running ones are done, the first one when there are more
+        void parallel_for(size_t n, std::function<void(size_t, size_t)> f){
+            std::scoped_lock loop(running_loop);
+
+            {
+                std::scoped_lock lock(m);
+                job = std::move(f);
+                chunks = n;
+                next_chunk = 0;
+                busy = workers.size();
+                ++generation;
+            }
+            start.notify_all();
+
+            run_chunks(0);
+
+            std::unique_lock lock(m);
+            done.wait(lock, [this]{ return busy == 0; });
+
+            if(failure){
+                std::rethrow_exception(std::exchange(failure, nullptr));
+            }
+        }
+
+    private:
+        void run_chunks(size_t thread){
+            try{
+                for(size_t c = next_chunk++; c < chunks; c = next_chunk++){
+                    job(thread, c);
+                }
+            }
+            catch(...){
+                next_chunk = chunks;
+
+                std::scoped_lock lock(m);
+                if(!failure){
+                    failure = std::current_exception();
+                }
+            }
+        }
+
+        void work(std::stop_token stop, size_t thread){
+            size_t seen = 0;
+
+            while(true){
+                {
+                    std::unique_lock lock(m);
+                    start.wait(lock, stop, [&]{ return generation != seen; });
+                    if(stop.stop_requested()){
+                        return;
+                    }
+                    seen = generation;
+                }
+
+                run_chunks(thread);
+
+                std::scoped_lock lock(m);
+                if(--busy == 0){
+                    done.notify_one();
+                }
+            }
+        }
+    };
+}
+}
+
+#endif
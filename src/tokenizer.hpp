@@ -3,16 +3,16 @@
 
 #include <string>
 #include <string_view>
-#include <list>
 #include <print>
 #include <algorithm>
 #include <cctype>
 #include <optional>
+#include <cstdint>
 #include <cstring>
 #include <utility>
 
-#include "ctre/single-header/ctre.hpp"
 #include "error.hpp"
+#include "lexer.hpp"
 
 using std::println;
 using std::print;
@@ -26,62 +26,40 @@ using std::print;
 #define WHT   "\x1B[37m"
 #define RESET "\x1B[0m"
 
-#define regex "(?<lit>([0-9]*[.])?[0-9]+)|"\
-              "(?<open_par>\\()|"\
-              "(?<closed_par>\\))|"\
-              "(?<plus>\\+)|"\
-              "(?<minus>-)|"\
-              "(?<exponent>\\^)|"\
-              "(?<asterisk>\\*)|"\
-              "(?<slash>\\/)|"\
-              "(?<factorial>!)|"\
-              "(?<abs>abs)|"\
-              "(?<floor>floor)|"\
-              "(?<ceil>ceil)|"\
-              "(?<space>\\s+)|.+"
-
 namespace calc{
 namespace{
 
-    struct tokenizer{
+    template<typename lexer>
+    struct basic_tokenizer : token_defs{
         using enum calc::calc_err_type_t;
 
-        enum class TOKEN_TYPE{
-            LIT,
-            OPEN_PAR,
-            CLOSED_PAR,
-            PLUS,
-            MINUS,
-            ASTERISK,
-            SLASH,
-            FACTORIAL,
-            EXPONENT,
-            ABS,
-            FLOOR,
-            CEIL,
-
-        };
-
-        struct token{
-            TOKEN_TYPE type;
-            // complete expression and ptrs to its portion which contains
-            // the actual token string
-            std::string full_expr;
-            size_t start;
-            size_t end;
-        };
-
-        //std::list<token> tokens since c++26 when std::list will be constexpr
-        std::vector<token> tokens;
-        std::string str;
-
-        constexpr tokenizer() = default;
-
-        [[nodiscard]] constexpr std::optional<calc_err> tokenize(std::string_view input){
-
-            tokens.clear();
-            str.clear();
-            size_t start, end = 0;
+        // view over the buffer owned by the caller, it must outlive the tokens
+        std::string_view str;
+        // offset of the first character not scanned yet
+        size_t pos = 0;
+        // tokens are scanned on demand: at most one is buffered for peek()
+        std::optional<token> lookahead;
+        // the first lexing error is sticky, the stream ends there
+        std::optional<calc_err> err;
+        // tokens scanned so far and how many are allowed
+        size_t count = 0;
+        size_t max_tokens = SIZE_MAX;
+
+        constexpr basic_tokenizer() = default;
+
+        // prepares the stream, no token is scanned until it is requested.
+        // Scanning more than max tokens is an error
+        [[nodiscard]] constexpr std::optional<calc_err> tokenize(
+            std::string_view input, 
+            size_t max = SIZE_MAX
+        ){
+
+            str = {};
+            pos = 0;
+            lookahead.reset();
+            err.reset();
+            count = 0;
+            max_tokens = max;
 
             if(input.size() == 0){
                 return calc_err::error_message(
@@ -92,94 +70,25 @@ namespace{
 
             str = input;
 
-            auto res = ctre::tokenize<regex>(str);
-            for(const auto& r : res){
-                TOKEN_TYPE t;
-
-                start = end;
-                end += r.str().size();
-
-                //println("Token '{}'", r.str());
-
-
-                if(r.get<"lit">()){
-                    t = TOKEN_TYPE::LIT;
-                }
-                else if(r.get<"open_par">()){
-                    t = TOKEN_TYPE::OPEN_PAR;
-                }
-                else if(r.get<"closed_par">()){
-                    t = TOKEN_TYPE::CLOSED_PAR;
-                }
-                else if(r.get<"plus">()){
-                    t = TOKEN_TYPE::PLUS;
-                }
-                else if(r.get<"minus">()){
-                    t = TOKEN_TYPE::MINUS;
-                }
-                else if(r.get<"asterisk">()){
-                    t = TOKEN_TYPE::ASTERISK;
-                }
-                else if(r.get<"slash">()){
-                    t = TOKEN_TYPE::SLASH;
-                }
-                else if(r.get<"factorial">()){
-                    t = TOKEN_TYPE::FACTORIAL;
-                }
-                else if(r.get<"exponent">()){
-                    t = TOKEN_TYPE::EXPONENT;
-                }
-                else if(r.get<"abs">()){
-                    t = TOKEN_TYPE::ABS;
-                }
-                else if(r.get<"floor">()){
-                    t = TOKEN_TYPE::FLOOR;
-                }
-                else if(r.get<"ceil">()){
-                    t = TOKEN_TYPE::CEIL;
-                }
-                else if(r.get<"space">()){
-                    continue;
-                }
-                else{
-                    auto err = calc_err::error_with_wrong_token(
-                        UNKNOWN_TOKEN, 
-                        "Unknown symbol found", 
-                        str, 
-                        start,
-                        end
-                    );
-                    // clear internal status
-                    tokens.clear();
-                    str.clear();
-
-                    return err;
-                }
-                tokens.emplace_back(t, str, start, end);
-            }
-
             return std::nullopt;
         }
 
-        [[nodiscard]] constexpr std::optional<token> peek() const {
-            if(tokens.empty())
-                return std::nullopt;
+        [[nodiscard]] constexpr std::optional<token> peek() {
+            if(!lookahead){
+                lookahead = scan();
+            }
 
-            return tokens.front();
+            return lookahead;
         }
 
         [[maybe_unused]] constexpr std::optional<token> next(){
             auto ret = peek();
-            if(ret){
-                //std::println("{}", ret->val);
-                tokens.erase(tokens.begin());
-                // tokens.pop_front() since c++26 when std::list will be constexpr
-            }
+            lookahead.reset();
 
             return ret;
         }
 
-        [[nodiscard]] constexpr bool match(TOKEN_TYPE other) const {
+        [[nodiscard]] constexpr bool match(TOKEN_TYPE other) {
             return peek().transform([&other]
                 (const token& tok){
                     return tok.type == other;      
@@ -194,10 +103,60 @@ namespace{
             return ret;
         }
 
-        [[nodiscard]] constexpr bool has_more_tokens() const {
-            return tokens.size() > 0;
+        [[nodiscard]] constexpr bool has_more_tokens() {
+            return peek().has_value();
+        }
+
+        [[nodiscard]] constexpr const std::optional<calc_err>& error() const {
+            return err;
+        }
+
+    private:
+        constexpr std::optional<token> scan(){
+            using enum lexeme::KIND;
+
+            while(!err && pos < str.size()){
+                const auto lex = lexer::scan(str.substr(pos));
+                const size_t start = pos;
+                pos += lex.size;
+
+                switch(lex.kind){
+                case TOKEN:
+                    if(++count > max_tokens){
+                        err = calc_err::error_with_wrong_token(
+                            LIMIT_EXCEEDED, 
+                            "Too many tokens, limit exceeded", 
+                            str, 
+                            start,
+                            pos
+                        );
+                        pos = str.size();
+                        break;
+                    }
+
+                    return token{lex.type, start, pos};
+
+                case SPACE:
+                    continue;
+
+                case UNKNOWN:
+                    err = calc_err::error_with_wrong_token(
+                        UNKNOWN_TOKEN, 
+                        "Unknown symbol found", 
+                        str, 
+                        start,
+                        pos
+                    );
+                    pos = str.size();
+                    break;
+                }
+            }
+
+            return std::nullopt;
         }
     };
+
+    using tokenizer = basic_tokenizer<default_lexer>;
 };
 };
 
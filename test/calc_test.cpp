@@ -1,6 +1,13 @@
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <functional>
+#include <random>
+
 #include "gtest/gtest.h"
 
 #include "constexpr-calculator/calculator.hpp"
+#include "constexpr-calculator/jit_expression.hpp"
 
 TEST(calc_test, identity){
     static_assert(calc::evaluate("1") == 1);
@@ -82,6 +89,9 @@ TEST(calc_test, factorial){
     static_assert(calc::evaluate("(5! / 2!) * 3!") == 360);
     static_assert(calc::evaluate("(5 + 3) * (2! / 1!)") == 16);
     static_assert(calc::evaluate("(6 + 2) * (3! / 2!)") == 24);
+    static_assert(calc::evaluate("0!") == 1);
+    static_assert(calc::evaluate("20!") == 2432902008176640000);
+    static_assert(calc::evaluate("170! / 169!").value() > 169.99);
 }
 
 TEST(calc_test, exponent){
@@ -96,7 +106,18 @@ TEST(calc_test, exponent){
     static_assert(calc::evaluate("-((2 + 1)! + 1) ^ 2") == 49);
     static_assert(calc::evaluate("(2 + 3)! - ((1 + 1) ^ 3)") == 112);
     static_assert(calc::evaluate("(5 + 1)! ^ 0 + 3") == 4);
+    static_assert(calc::evaluate("2^-5") == 1. / 32);
+    static_assert(calc::evaluate("(-2)^3") == -8);
+    static_assert(calc::evaluate("(-2)^-2") == 0.25);
+    static_assert(calc::evaluate("0^3") == 0);
+    static_assert(calc::evaluate("0^0") == 1);
+    static_assert(calc::evaluate("1^100000000000000000") == 1);
+    static_assert(calc::evaluate("2^1023 / 2^1022") == 2);
+    EXPECT_EQ(calc::evaluate("10^-400"), 0);
 
+    // bounded time, whatever the exponent
+    EXPECT_GT(calc::evaluate("1.0000001^100000000").value(), 22026);
+    EXPECT_LT(calc::evaluate("1.0000001^100000000").value(), 22027);
 }
 
 TEST(calc_test, unary_functions){
@@ -121,7 +142,8 @@ TEST(calc_test, syntax_errors){
     static_assert(calc::evaluate("").error().get_err_type() == EMPTY_EXPRESSION);
     static_assert(calc::evaluate("()").error().get_err_type() == INVALID_EXPR);
 
-    static_assert(calc::evaluate("1 + 1p").error().get_err_type() == UNKNOWN_TOKEN);
+    static_assert(calc::evaluate("1 + 1$").error().get_err_type() == UNKNOWN_TOKEN);
+    static_assert(calc::evaluate("1 + 1p").error().get_err_type() == UNEXPECTED_TOKEN);
 
     static_assert(calc::evaluate("(3+4").error().get_err_type() == EXPECTED_TOKEN);
     static_assert(calc::evaluate("1+").error().get_err_type() == EXPECTED_TOKEN);
@@ -129,6 +151,11 @@ TEST(calc_test, syntax_errors){
 
     static_assert(calc::evaluate("abs 1").error().get_err_type() == EXPECTED_TOKEN);
     static_assert(calc::evaluate("abs()").error().get_err_type() == INVALID_EXPR);
+
+    // tokens are scanned on demand: the parser stops at the first error
+    static_assert(calc::evaluate("1 + 1 $").error().get_err_type() == UNKNOWN_TOKEN);
+    static_assert(calc::evaluate("1 + $ 1").error().get_err_type() == UNKNOWN_TOKEN);
+    static_assert(calc::evaluate(") $").error().get_err_type() == INVALID_EXPR);
 }
 
 TEST(calc_test, evaluation_errors){
@@ -146,6 +173,1113 @@ TEST(calc_test, evaluation_errors){
     EXPECT_EQ(calc::evaluate("10000^1000 * 100000000000000000").error().get_err_type(), OVERFLOW_UNDERFLOW);
     EXPECT_EQ(calc::evaluate("10000^1000 / 0.00000000000000001").error().get_err_type(), OVERFLOW_UNDERFLOW);
 
-    static_assert(calc::evaluate("2^-5").error().get_err_type() == UNEXPECTED_VALUE);
+    static_assert(calc::evaluate("2^0.5").error().get_err_type() == UNEXPECTED_VALUE);
+    static_assert(calc::evaluate("0^-1").error().get_err_type() == DIVISION_BY_ZERO);
+    EXPECT_EQ(calc::evaluate("171!").error().get_err_type(), OVERFLOW_UNDERFLOW);
+    EXPECT_EQ(calc::evaluate("0.5^-100000").error().get_err_type(), OVERFLOW_UNDERFLOW);
+
+}
+
+TEST(calc_test, long_expression){
+    std::string expr = "1";
+    for(int i = 0; i < 3000; ++i){
+        expr += " + 1";
+    }
+
+    EXPECT_EQ(calc::evaluate(expr), 3001);
+}
+
+template<typename lexer_1, typename lexer_2>
+constexpr bool same_tokens(std::string_view input){
+    calc::basic_tokenizer<lexer_1> t1;
+    calc::basic_tokenizer<lexer_2> t2;
+
+    if(t1.tokenize(input).has_value() != t2.tokenize(input).has_value()){
+        return false;
+    }
+
+    while(t1.has_more_tokens() || t2.has_more_tokens()){
+        auto tok1 = t1.next();
+        auto tok2 = t2.next();
+
+        if(!tok1 || !tok2 || tok1->type != tok2->type || 
+            tok1->start != tok2->start || tok1->end != tok2->end
+        ){
+            return false;
+        }
+    }
+
+    if(t1.error().has_value() != t2.error().has_value()){
+        return false;
+    }
+
+    return !t1.error() || (
+        t1.error()->get_err_type() == t2.error()->get_err_type() &&
+        t1.error()->get_start() == t2.error()->get_start() &&
+        t1.error()->get_end() == t2.error()->get_end()
+    );
+}
+
+TEST(calc_test, lexer_backends){
+    using ctre_lexer = calc::ctre_lexer;
+    using table_lexer = calc::table_lexer;
+
+    static_assert(same_tokens<ctre_lexer, table_lexer>("1+2.5*(3-.5)/4^2!"));
+    static_assert(same_tokens<ctre_lexer, table_lexer>("abs(1) + floor(2) - ceil(3)"));
+    static_assert(same_tokens<ctre_lexer, table_lexer>("  1 \t+\n1 "));
+    static_assert(same_tokens<ctre_lexer, table_lexer>("1.2.3"));
+    static_assert(same_tokens<ctre_lexer, table_lexer>("1."));
+    static_assert(same_tokens<ctre_lexer, table_lexer>("."));
+    static_assert(same_tokens<ctre_lexer, table_lexer>("1 + 1p"));
+    static_assert(same_tokens<ctre_lexer, table_lexer>("absx(1)"));
+    static_assert(same_tokens<ctre_lexer, table_lexer>("1 $ 2"));
+    static_assert(same_tokens<ctre_lexer, table_lexer>(""));
+    static_assert(same_tokens<ctre_lexer, table_lexer>("1e5 + 2.5E-3 * .5e+2"));
+    static_assert(same_tokens<ctre_lexer, table_lexer>("2e + 1e- 3E+x"));
+
+    static_assert(calc::keywords::find("abs") == calc::token_defs::TOKEN_TYPE::ABS);
+    static_assert(calc::keywords::find("floor") == calc::token_defs::TOKEN_TYPE::FLOOR);
+    static_assert(calc::keywords::find("ceil") == calc::token_defs::TOKEN_TYPE::CEIL);
+    static_assert(!calc::keywords::find("cei"));
+    static_assert(!calc::keywords::find("absx"));
+}
+
+constexpr bool same_result(const calc::evaluation_t& a, const calc::evaluation_t& b){
+    if(a.has_value() != b.has_value()){
+        return false;
+    }
+
+    // -0 and 0 compare equal, they don't print the same. NaN doesn't
+    // compare equal to itself
+    if(a){
+        return (a == *b || (std::isnan(*a) && std::isnan(*b))) && std::signbit(*a) == std::signbit(*b);
+    }
+
+    return a.error().get_err_type() == b.error().get_err_type() &&
+        a.error().get_start() == b.error().get_start() &&
+        a.error().get_end() == b.error().get_end();
+}
+
+// a row of a batch against the scalar result of the same values
+constexpr bool same_lane(const calc::evaluation_t& expected, calc::num_t out, calc::lane_err err){
+    using enum calc::calc_err_type_t;
+
+    if(expected){
+        return err == calc::lane_err::NONE && same_result(expected, out);
+    }
+
+    const auto type = expected.error().get_err_type();
+    const auto lane = 
+        type == DIVISION_BY_ZERO ? calc::lane_err::DIVISION_BY_ZERO :
+        type == OVERFLOW_UNDERFLOW ? calc::lane_err::OVERFLOW_UNDERFLOW :
+        calc::lane_err::UNEXPECTED_VALUE;
+
+    return err == lane && std::isnan(out);
+}
+
+constexpr size_t no_pass(calc::compiled_expression&){
+    return 0;
+}
+
+// the passes of consistent()
+constexpr auto simplify = &calc::compiled_expression::simplify;
+constexpr auto deduplicate = &calc::compiled_expression::deduplicate;
+
+// compiles str with the variables x and y, columns[i] holding the values
+// of slot i, and applies pass to it. Every row is evaluated before and
+// after: twice with the bytecode, with the tree and in a batch. Returns what
+// pass returned, nothing if a result differs from the first one
+template<typename F>
+constexpr std::optional<size_t> consistent(
+    std::string_view str, 
+    std::span<const std::span<const calc::num_t>> columns, 
+    size_t rows, 
+    F pass
+){
+    auto c = calc::compile(str, {"x", "y"});
+    if(!c){
+        return std::nullopt;
+    }
+
+    const auto row = [&](size_t r){
+        std::vector<calc::num_t> ret;
+        for(auto column : columns){
+            ret.push_back(column[r]);
+        }
+
+        return ret;
+    };
+
+    std::vector<calc::evaluation_t> expected;
+    for(size_t r = 0; r < rows; ++r){
+        expected.push_back(c->evaluate(row(r)));
+    }
+
+    const auto same = [&]{
+        std::vector<calc::num_t> out(rows);
+        std::vector<calc::lane_err> errors(rows);
+        // a missing column fails the whole batch
+        const auto batch_err = c->evaluate_batch(columns, out, errors);
+
+        for(size_t r = 0; r < rows; ++r){
+            const auto values = row(r);
+            const bool batch_ok = batch_err ? 
+                same_result(expected[r], std::unexpected(*batch_err)) :
+                same_lane(expected[r], out[r], errors[r]);
+
+            if(!batch_ok ||
+                !same_result(expected[r], c->evaluate(values)) || 
+                !same_result(expected[r], c->evaluate_tree(values))
+            ){
+                return false;
+            }
+        }
+
+        return true;
+    };
+
+    if(!same()){
+        return std::nullopt;
+    }
+
+    const size_t ret = std::invoke(pass, *c);
+    if(!same()){
+        return std::nullopt;
+    }
+
+    return ret;
+}
+
+// a single row: the value of x, then the one of y
+template<typename F = decltype(&no_pass)>
+constexpr std::optional<size_t> consistent(
+    std::string_view str, 
+    std::initializer_list<calc::num_t> values = {}, 
+    F pass = no_pass
+){
+    std::vector<std::span<const calc::num_t>> columns;
+    for(const auto& v : values){
+        columns.emplace_back(&v, 1);
+    }
+
+    return consistent(str, columns, 1, pass);
+}
+
+// a row per value of xs
+template<typename F = decltype(&no_pass)>
+constexpr std::optional<size_t> consistent(
+    std::string_view str, 
+    std::span<const calc::num_t> xs, 
+    std::span<const calc::num_t> ys, 
+    F pass = no_pass
+){
+    const std::array columns{xs, ys};
+
+    return consistent(str, columns, xs.size(), pass);
+}
+
+TEST(calc_test, compile){
+    using enum calc::calc_err_type_t;
+
+    static_assert(calc::compile("(1 + 2) * 3!")->evaluate() == 18);
+    static_assert(consistent("(1 + 2) * 3!"));
+    static_assert(calc::compile("1 +").error().get_err_type() == EXPECTED_TOKEN);
+    static_assert(calc::compile("1 / 0").has_value());
+    static_assert(calc::compile("1 / 0")->evaluate().error().get_err_type() == DIVISION_BY_ZERO);
+
+    std::vector<calc::compiled_expression> exprs;
+    for(auto str : {"1 + 1", "2 * 3", "abs(-4)", "10 / (5 - 5)"}){
+        auto c = calc::compile(str);
+        ASSERT_TRUE(c.has_value());
+        exprs.push_back(std::move(*c));
+    }
+
+    for(int i = 0; i < 3; ++i){
+        EXPECT_EQ(exprs[0].evaluate(), 2);
+        EXPECT_EQ(exprs[1].evaluate(), 6);
+        EXPECT_EQ(exprs[2].evaluate(), 4);
+        EXPECT_EQ(exprs[3].evaluate().error().get_err_type(), DIVISION_BY_ZERO);
+    }
+
+    auto moved = std::move(exprs[1]);
+    EXPECT_EQ(moved.evaluate(), 6);
+    EXPECT_EQ(moved.expression(), "2 * 3");
+}
+
+constexpr calc::evaluation_t evaluate_with(
+    std::string_view str, 
+    std::initializer_list<calc::num_t> values
+){
+    auto c = calc::compile(str);
+    if(!c){
+        return std::unexpected(c.error());
+    }
+
+    return c->evaluate(values);
+}
+
+TEST(calc_test, variables){
+    using enum calc::calc_err_type_t;
+
+    static_assert(evaluate_with("x", {2}) == 2);
+    static_assert(evaluate_with("x * x + 3 * y", {2, 5}) == 19);
+    static_assert(evaluate_with("rate * t0 - rate", {2, 5}) == 8);
+    static_assert(evaluate_with("abs(x_1) + floor(y)!", {-1.5, 3.5}) == 7.5);
+    static_assert(evaluate_with("x", {}).error().get_err_type() == UNBOUND_VARIABLE);
+    static_assert(evaluate_with("x + y", {1}).error().get_err_type() == UNBOUND_VARIABLE);
+    static_assert(calc::evaluate("2 * x").error().get_err_type() == UNBOUND_VARIABLE);
+    static_assert(calc::evaluate("x y").error().get_err_type() == UNEXPECTED_TOKEN);
+
+    auto c = calc::compile("y / x + x");
+    ASSERT_TRUE(c.has_value());
+    ASSERT_EQ(c->variables().size(), 2);
+    EXPECT_EQ(c->variables()[0], "y");
+    EXPECT_EQ(c->slot("x"), 1);
+    EXPECT_EQ(c->slot("z"), std::nullopt);
+
+    std::array<calc::num_t, 2> values{};
+    for(int i = 1; i <= 10; ++i){
+        values[0] = i;
+        values[1] = 2;
+        EXPECT_EQ(c->evaluate(values), i / 2. + 2);
+    }
+    EXPECT_EQ(c->evaluate({1, 0}).error().get_err_type(), DIVISION_BY_ZERO);
+
+    auto declared = calc::compile("y / x", {"x", "y"});
+    ASSERT_TRUE(declared.has_value());
+    EXPECT_EQ(declared->evaluate({2, 10}), 5);
+    EXPECT_EQ(calc::compile("y / z", {"x", "y"}).error().get_err_type(), UNKNOWN_VARIABLE);
+}
+
+TEST(calc_test, bytecode){
+    static_assert(consistent("1"));
+    static_assert(consistent("-(1 + 2) * 3! / 4 ^ 2"));
+    static_assert(consistent("abs(x) - floor(y) + ceil(x * y)", {-1.5, 2.5}));
+    static_assert(consistent("(5 * 2)! / (3! * 2!)"));
+    static_assert(consistent("1 / (x - x) + 10000^1000", {3}));
+    EXPECT_TRUE(consistent("10000^1000 + 1 / (x - x)", {3}));
+    static_assert(consistent("2^-5 + (-1)!"));
+    static_assert(consistent("x + y", {1}));
+
+    // with a variable at the bottom: integer literals alone are folded
+    std::string deep = "x";
+    for(int i = 0; i < 200; ++i){
+        deep = "1 + (" + deep + ")";
+    }
+    EXPECT_TRUE(consistent(deep, {1}));
+    EXPECT_EQ(calc::compile(deep)->evaluate({1}), 201);
+    EXPECT_GT(calc::compile(deep)->bytecode().max_stack, 64);
+}
+
+TEST(calc_test, simplify){
+    static_assert(consistent("1", {}, simplify) == 0);
+    static_assert(consistent("(2 + 3) * x", {4}, simplify) == 2);
+    static_assert(consistent("abs(-4)^2 * x", {0.5}, simplify) == 4);
+    static_assert(consistent("-(1 + 2) * 3! / 4 ^ 2", {}, simplify) == 10);
+    static_assert(consistent("(x - 2) * 1", {3}, simplify) == 2);
+    static_assert(consistent("1 * (x - 2) / 1", {3}, simplify) == 4);
+    static_assert(consistent("x + 0 - 0", {3}, simplify) == 2);
+    static_assert(consistent("(1 - 1) + x", {3}, simplify) == 2);
+    static_assert(consistent("(x - 2) + -0", {3}, simplify) == 3);
+    static_assert(consistent("x + 0", {-0.}, simplify) == 0);
+    static_assert(consistent("-(-(x - 2))", {3}, simplify) == 2);
+    static_assert(consistent("floor(floor(x))", {3.5}, simplify) == 1);
+    static_assert(consistent("ceil(floor(abs(abs(x))))", {-3.5}, simplify) == 2);
+    static_assert(consistent("x * 2 + y", {3, 4}, simplify) == 0);
+
+    // the operators report a variable which is inf or NaN, they stay
+    constexpr auto inf = std::numeric_limits<calc::num_t>::infinity();
+    static_assert(consistent("x * 1", {3}, simplify) == 0);
+    EXPECT_EQ(consistent("x * 1", {inf}, simplify), 0);
+    EXPECT_EQ(consistent("abs(x) * 1 + -0", {inf}, simplify), 3);
+    EXPECT_EQ(consistent("1 * x / 1 + -0 - 0", {-inf}, simplify), 7);
+    EXPECT_EQ(consistent("-(-x)", {std::nan("")}, simplify), 0);
+    EXPECT_EQ(consistent("x! * 1", {inf}, simplify), 2);
+    EXPECT_EQ(consistent("(x - 1) * 1", {std::nan("")}, simplify), 2);
+    EXPECT_EQ(consistent("floor(floor(x))", {inf}, simplify), 1);
+
+    // failing subtrees stay, the error keeps its span
+    static_assert(consistent("1 / 0 + x", {1}, simplify) == 0);
+    static_assert(consistent("x + (1 - 1)! + (-2)!", {1}, simplify) == 4);
+    static_assert(consistent("x / (1 - 1)", {1}, simplify) == 2);
+    EXPECT_EQ(consistent("10000^1000 * x + 2 * 3", {1}, simplify), 2);
+
+    auto c = calc::compile("(2 + 3) * x");
+    ASSERT_TRUE(c.has_value());
+    EXPECT_EQ(c->simplify(), 2);
+    EXPECT_EQ(c->syntax_tree().nodes.size(), 3);
+    EXPECT_EQ(c->bytecode().code.size(), 3);
+    EXPECT_EQ(c->evaluate({2}), 10);
+    EXPECT_EQ(c->simplify(), 0);
+
+    // -(-x) overflows for the smallest integer, it stays
+    auto i = calc::basic_compile<int64_t>("-(-x) + 2 * 3", {"x"});
+    ASSERT_TRUE(i.has_value());
+    EXPECT_EQ(i->simplify(), 2);
+    EXPECT_EQ(i->evaluate({INT64_MIN}).error().get_err_type(), calc::calc_err_type_t::OVERFLOW_UNDERFLOW);
+    EXPECT_EQ(i->evaluate({5}), 11);
+}
+
+TEST(calc_test, batch){
+    static constexpr std::array<calc::num_t, 5> xs{1, -2.5, 0, 3, 4};
+    static constexpr std::array<calc::num_t, 5> ys{2, 2, 3, 0.5, -1};
+
+    static_assert(consistent("x * x + 3 * y", xs, ys));
+    static_assert(consistent("-abs(x) + floor(y) - ceil(x / 2)", xs, ys));
+    static_assert(consistent("x ^ 2 + (y * 2)!", xs, ys));
+    static_assert(consistent("y / x", xs, ys));
+    static_assert(consistent("x ^ y + y / x", xs, ys));
+
+    // more rows than a block, overflow and errors after a failure
+    std::vector<calc::num_t> many_x, many_y;
+    for(int i = 0; i < 1000; ++i){
+        many_x.push_back(i % 7 - 3);
+        many_y.push_back(i % 11 * 40.5);
+    }
+    EXPECT_TRUE(consistent("10 ^ y * x", many_x, many_y));
+    EXPECT_TRUE(consistent("y / x + (1 / (x - x))", many_x, many_y));
+    EXPECT_TRUE(consistent("(y / 10)! / x + x ^ 2", many_x, many_y));
+    EXPECT_TRUE(consistent("x", std::span(xs).first(0), std::span(ys).first(0)));
+
+    auto c = calc::compile("x + y");
+    ASSERT_TRUE(c.has_value());
+    std::array<calc::num_t, 1> out;
+    std::array<calc::lane_err, 1> errors;
+    const std::array<std::span<const calc::num_t>, 1> columns{std::span(xs).first(1)};
+    EXPECT_EQ(
+        c->evaluate_batch(columns, out, errors)->get_err_type(), 
+        calc::calc_err_type_t::UNBOUND_VARIABLE
+    );
+}
+
+TEST(calc_test, parallel_batch){
+    auto c = calc::compile("y / x + x ^ 2 - floor(y)!", {"x", "y"});
+    ASSERT_TRUE(c.has_value());
+
+    // not a multiple of the chunk size
+    const size_t rows = 100003;
+    std::vector<calc::num_t> xs, ys;
+    for(size_t i = 0; i < rows; ++i){
+        xs.push_back(static_cast<calc::num_t>(i % 13) - 6);
+        ys.push_back(static_cast<calc::num_t>(i % 17) * 12.5);
+    }
+    const std::array<std::span<const calc::num_t>, 2> columns{xs, ys};
+
+    std::vector<calc::num_t> expected(rows);
+    std::vector<calc::lane_err> expected_errors(rows);
+    ASSERT_FALSE(c->evaluate_batch(columns, expected, expected_errors));
+
+    for(size_t threads : {1, 2, 4, 7}){
+        calc::thread_pool pool(threads);
+        EXPECT_EQ(pool.size(), threads);
+
+        // the pool is reused
+        for(int run = 0; run < 3; ++run){
+            std::vector<calc::num_t> out(rows);
+            std::vector<calc::lane_err> errors(rows);
+            ASSERT_FALSE(c->evaluate_batch(columns, out, errors, pool));
+
+            EXPECT_EQ(errors, expected_errors);
+            for(size_t i = 0; i < rows; ++i){
+                ASSERT_TRUE(std::isnan(expected[i]) ? 
+                    std::isnan(out[i]) : 
+                    calc::evaluation_t(out[i]) == expected[i]
+                );
+            }
+        }
+    }
+
+    calc::thread_pool pool(2);
+    std::vector<calc::num_t> out(rows);
+    std::vector<calc::lane_err> errors(rows);
+    EXPECT_EQ(
+        c->evaluate_batch(std::span(columns).first(1), out, errors, pool)->get_err_type(),
+        calc::calc_err_type_t::UNBOUND_VARIABLE
+    );
+
+    // an exception reaches the caller, whichever thread threw it, and the
+    // pool can still be used
+    for(size_t failing : {0, 5, 99}){
+        std::atomic<size_t> ran = 0;
+        EXPECT_THROW(pool.parallel_for(100, [&](size_t, size_t chunk){
+            if(chunk == failing){
+                throw std::runtime_error("chunk failed");
+            }
+            ++ran;
+        }), std::runtime_error);
+        EXPECT_LT(ran, 100);
+    }
+    std::atomic<size_t> ran = 0;
+    pool.parallel_for(100, [&](size_t, size_t){
+        ++ran;
+    });
+    EXPECT_EQ(ran, 100);
+}
+
+TEST(calc_test, static_compile){
+    using enum calc::calc_err_type_t;
+
+    static constexpr auto f = calc::compile<"x*x + 3*y">();
+    static_assert(f(2, 5) == 19);
+    static_assert(f(1.5, -1) == -0.75);
+    static_assert(f.variables.size() == 2);
+    static_assert(f.variables[1] == "y");
+
+    static_assert(calc::compile<"(1 + 2) * 3!">()() == 18);
+    static_assert(calc::compile<"abs(x) - floor(y) + ceil(x * y)">()(-1.5, 2.5) == -3.5);
+    static_assert(calc::compile<"rate * t0 - rate">()(2, 5) == 8);
+
+    // slots follow the order of first appearance: y, x
+    static constexpr auto g = calc::compile<"y / x + 2 ^ x">();
+    static_assert(g.variables[0] == "y");
+    static_assert(g(1, 0).error().get_err_type() == DIVISION_BY_ZERO);
+    static_assert(g(1, 2) == 4.5);
+    static_assert(g(1, -2) == -0.25);
+    static_assert(g(1, 0.5).error().get_err_type() == UNEXPECTED_VALUE);
+
+    // same results as the parsed expression, at run time too
+    auto c = calc::compile("y / x + 2 ^ x");
+    ASSERT_TRUE(c.has_value());
+    for(calc::num_t x : {-2., 0., 1., 3.}){
+        for(calc::num_t y : {-1., 0., 4.5}){
+            EXPECT_TRUE(same_result(g(y, x), c->evaluate({y, x})));
+        }
+    }
+    EXPECT_EQ(g(1, 0).error().get_start(), c->evaluate({1, 0}).error().get_start());
+    EXPECT_EQ(calc::compile<"10000^1000 * x">()(1).error().get_err_type(), OVERFLOW_UNDERFLOW);
+}
+
+// every function taking the expression as a string
+template<typename S>
+concept accepts_string = requires(S&& s, const calc::limits& l){
+    calc::evaluate(std::forward<S>(s));
+    calc::evaluate(std::forward<S>(s), l);
+    calc::basic_evaluate<float>(std::forward<S>(s));
+    calc::compile(std::forward<S>(s));
+    calc::compile(std::forward<S>(s), l);
+    calc::compile(std::forward<S>(s), {"x"});
+    calc::basic_compile<float>(std::forward<S>(s));
+    calc::basic_compile<float>(std::forward<S>(s), {"x"});
+};
+
+// none of them
+template<typename S>
+concept rejects_string =
+    !requires(S&& s){ calc::evaluate(std::forward<S>(s)); } &&
+    !requires(S&& s, const calc::limits& l){ calc::evaluate(std::forward<S>(s), l); } &&
+    !requires(S&& s){ calc::basic_evaluate<float>(std::forward<S>(s)); } &&
+    !requires(S&& s){ calc::compile(std::forward<S>(s)); } &&
+    !requires(S&& s, const calc::limits& l){ calc::compile(std::forward<S>(s), l); } &&
+    !requires(S&& s){ calc::compile(std::forward<S>(s), {"x"}); } &&
+    !requires(S&& s){ calc::basic_compile<float>(std::forward<S>(s)); } &&
+    !requires(S&& s){ calc::basic_compile<float>(std::forward<S>(s), {"x"}); };
+
+TEST(calc_test, error_spans){
+    using enum calc::calc_err_type_t;
+
+    static_assert(sizeof(calc::evaluation_t) <= 40);
+
+    // spans refer to the input as it is, spaces included
+    static_assert(calc::evaluate("1  +   $").error().get_start() == 7);
+    static_assert(calc::evaluate("1 /   (2 - 2)").error().get_start() == 2);
+    static_assert(calc::evaluate("1 /   (2 - 2)").error().get_expr() == "1 /   (2 - 2)");
+    static_assert(!calc::evaluate("").error().get_start());
 
-}
\ No newline at end of file
+    // longer than the old 127 characters buffers
+    std::string long_expr;
+    for(int i = 0; i < 100; ++i){
+        long_expr += "1 + ";
+    }
+    long_expr += "1 / 0";
+    const auto err = calc::evaluate(long_expr).error();
+    EXPECT_EQ(err.get_err_type(), DIVISION_BY_ZERO);
+    EXPECT_EQ(err.get_start(), long_expr.size() - 3);
+    EXPECT_EQ(err.get_end(), long_expr.size() - 2);
+    EXPECT_EQ(err.get_expr(), long_expr);
+
+    // the error of a compiled expression survives moving it
+    auto c = calc::compile("x / (x - x)");
+    ASSERT_TRUE(c.has_value());
+    const auto eval_err = c->evaluate({1}).error();
+    auto moved = std::move(*c);
+    EXPECT_EQ(eval_err.get_expr(), "x / (x - x)");
+    EXPECT_EQ(eval_err.get_expr()->data(), moved.expression().data());
+
+    // syntax errors of compile() refer to the caller's string
+    const std::string input = "2 * (3 + ";
+    const auto syntax_err = calc::compile(input).error();
+    EXPECT_EQ(syntax_err.get_expr()->data(), input.data());
+
+    // the errors would outlive a temporary string
+    static_assert(accepts_string<std::string&>);
+    static_assert(accepts_string<const std::string&>);
+    static_assert(accepts_string<std::string_view>);
+    static_assert(accepts_string<const char(&)[4]>);
+    static_assert(rejects_string<std::string>);
+    static_assert(rejects_string<std::string&&>);
+
+    const auto text = std::format("{}", err);
+    EXPECT_NE(text.find("Division by 0 detected"), std::string::npos);
+    EXPECT_NE(text.find(long_expr.substr(0, 200)), std::string::npos);
+}
+
+TEST(calc_test, deep_expressions){
+    using enum calc::calc_err_type_t;
+
+    // deeper than any call stack would allow
+    const size_t depth = 100000;
+    std::string nested;
+    for(size_t i = 0; i < depth; ++i){
+        nested += i % 2 ? "-(" : "abs(";
+    }
+    nested += "x";
+    nested += std::string(depth, ')');
+
+    auto c = calc::compile(nested);
+    ASSERT_TRUE(c.has_value());
+    EXPECT_EQ(c->evaluate({-2}), 2);
+    EXPECT_EQ(c->evaluate_tree(std::array<calc::num_t, 1>{-2}), 2);
+    EXPECT_EQ(c->simplify(), 0);
+    EXPECT_EQ(c->evaluate({3}), 3);
+
+    EXPECT_EQ(calc::evaluate(std::string_view(nested).substr(0, nested.size() - 1)).error().get_err_type(), EXPECTED_TOKEN);
+
+    // long left leaning chain
+    std::string sum = "1";
+    for(size_t i = 0; i < 200000; ++i){
+        sum += i % 2 ? " + 2" : " - 1";
+    }
+    EXPECT_EQ(calc::evaluate(sum), 100001);
+}
+
+TEST(calc_test, precedence){
+    using enum calc::calc_err_type_t;
+
+    static_assert(calc::evaluate("1 - 2 - 3") == -4);
+    static_assert(calc::evaluate("12 / 3 / 2") == 2);
+    static_assert(calc::evaluate("1 + 2 * 3 - 4 / 2") == 5);
+    static_assert(calc::evaluate("2 * 3^2") == 18);
+
+    // the sign binds tighter than '^' and looser than '!'
+    static_assert(calc::evaluate("-2^2") == 4);
+    static_assert(calc::evaluate("2^-2") == 0.25);
+    static_assert(calc::evaluate("-3!") == -6);
+    static_assert(calc::evaluate("2^3!") == 64);
+    static_assert(calc::evaluate("3!^2") == 36);
+    static_assert(calc::evaluate("abs(-3)!") == 6);
+    static_assert(calc::evaluate("-abs(-3)") == -3);
+
+    // '^', '!' and the sign can't be chained
+    static_assert(calc::evaluate("2^3^4").error().get_err_type() == UNEXPECTED_TOKEN);
+    static_assert(calc::evaluate("1 + 2^3^4").error().get_err_type() == UNEXPECTED_TOKEN);
+    static_assert(calc::evaluate("3!!").error().get_err_type() == UNEXPECTED_TOKEN);
+    static_assert(calc::evaluate("-3!!").error().get_err_type() == UNEXPECTED_TOKEN);
+    static_assert(calc::evaluate("--3").error().get_err_type() == INVALID_EXPR);
+    static_assert(calc::evaluate("2^--3").error().get_err_type() == INVALID_EXPR);
+    static_assert(calc::evaluate("(2^3)^2") == 64);
+    static_assert(calc::evaluate("-(-3)") == 3);
+}
+
+// the literal gives the same bits as std::from_chars
+bool same_as_from_chars(const std::string& s){
+    double expected = 0;
+    const auto [_, ec] = std::from_chars(s.data(), s.data() + s.size(), expected);
+    const auto got = calc::evaluate(s);
+
+    if(ec != std::errc{}){
+        return !got.has_value() || got == 0.;
+    }
+
+    return got.has_value() && std::memcmp(&expected, &*got, sizeof(expected)) == 0;
+}
+
+TEST(calc_test, literals){
+    using enum calc::calc_err_type_t;
+
+    static_assert(calc::evaluate("1e3") == 1000);
+    static_assert(calc::evaluate("2.5E-3") == 2.5e-3);
+    static_assert(calc::evaluate(".5e+1") == 5);
+    static_assert(calc::evaluate("0.1") == 0.1);
+    static_assert(calc::evaluate("1e-9 * 1e9") == 1);
+    static_assert(calc::evaluate("2e1e1").error().get_err_type() == UNEXPECTED_TOKEN);
+    static_assert(calc::evaluate("2e").error().get_err_type() == UNEXPECTED_TOKEN);
+    static_assert(calc::evaluate("1e400").error().get_err_type() == INVALID_LITERAL);
+
+    // past the 19 digits of the fast path
+    static_assert(calc::evaluate("123456789012345678901234567890") == 123456789012345678901234567890.);
+    static_assert(calc::evaluate("9007199254740993") == 9007199254740992.);
+    static_assert(calc::evaluate("2.2250738585072011e-308") == 2.2250738585072011e-308);
+    static_assert(calc::evaluate("4.9406564584124654e-324") == 4.9406564584124654e-324);
+    static_assert(calc::evaluate("1.7976931348623157e308") == 1.7976931348623157e308);
+
+    for(const auto* s : {
+        "9007199254740992.5", "9007199254740993.0000000000000000001", "1e23", 
+        "7.2057594037927933e16", "2.4703282292062327e-324", "2.4703282292062328e-324",
+        "8.98846567431157953864652595394512366e307", "0.000000000000000000000000000001",
+    }){
+        EXPECT_TRUE(same_as_from_chars(s)) << s;
+    }
+
+    std::mt19937_64 rng(42);
+    for(size_t i = 0; i < 100000; ++i){
+        const auto bits = rng() >> 1;
+        double d = 0;
+        std::memcpy(&d, &bits, sizeof(d));
+        if(!std::isfinite(d)){
+            continue;
+        }
+
+        std::array<char, 64> buf{};
+        std::snprintf(buf.data(), buf.size(), "%.*e", static_cast<int>(rng() % 20), d);
+        EXPECT_TRUE(same_as_from_chars(buf.data())) << buf.data();
+
+        std::string digits;
+        for(size_t k = rng() % 40; k-- > 0;){
+            digits += static_cast<char>('0' + rng() % 10);
+        }
+        digits += "1e" + std::to_string(static_cast<int>(rng() % 700) - 350);
+        EXPECT_TRUE(same_as_from_chars(digits)) << digits;
+    }
+}
+
+TEST(calc_test, cache){
+    using enum calc::calc_err_type_t;
+
+    EXPECT_EQ(calc::normalise("  1 +\t2 * x  "), "1+2*x");
+    EXPECT_EQ(calc::normalise("1 2"), "1 2");
+    EXPECT_EQ(calc::normalise("2e +3"), "2e +3");
+    EXPECT_EQ(calc::normalise("1e- 5"), "1e- 5");
+    EXPECT_EQ(calc::normalise("2 * 1E+ 5"), "2*1E+ 5");
+    EXPECT_EQ(calc::normalise("1 .5 + abs (x)"), "1 .5+abs(x)");
+
+    calc::evaluation_cache values(64, 4);
+
+    auto a = values.get("1 + 2 * 3");
+    auto b = values.get("1+2*3");
+    EXPECT_EQ(a, b);
+    EXPECT_EQ(a->value, 7);
+    EXPECT_EQ(values.stats().hits, 1);
+    EXPECT_EQ(values.stats().misses, 1);
+
+    // the spacing that changes the tokens is kept
+    EXPECT_EQ(values.get("12")->value, 12);
+    EXPECT_EQ(values.get("1 2")->value.error().get_err_type(), UNEXPECTED_TOKEN);
+    EXPECT_EQ(values.get("2e+3")->value, 2000);
+    EXPECT_EQ(values.get("2e +3")->value.error().get_err_type(), UNEXPECTED_TOKEN);
+    for(std::string_view str : {"1e- 5", "1E+ 5", "2*1e- 5"}){
+        ASSERT_FALSE(values.get(str)->value.has_value()) << str;
+        EXPECT_EQ(values.get(str)->value.error().get_err_type(), calc::evaluate(str).error().get_err_type()) << str;
+    }
+
+    // errors refer to the expression kept by the entry
+    auto err = values.get("1 / (2 - 2)");
+    EXPECT_EQ(err->value.error().get_err_type(), DIVISION_BY_ZERO);
+    EXPECT_EQ(err->value.error().get_expr(), "1/(2-2)");
+    EXPECT_EQ(err->value.error().get_start(), 1);
+
+    // locate() gives their span in the string passed to get()
+    for(std::string_view str : {"  1 /   (2 - 2)", "1   2", " 2e  +3", "abs( -1)!  + (0 - 3)! ", "x  +\t2"}){
+        const auto located = calc::locate(values.get(str)->value.error(), str);
+        EXPECT_EQ(located.get_expr()->data(), str.data());
+        EXPECT_TRUE(same_result(std::unexpected(located), calc::evaluate(str))) << str;
+    }
+
+    // least recently used first, an evicted entry stays valid for its holders
+    calc::evaluation_cache small(2, 1);
+    auto one = small.get("1");
+    small.get("2");
+    small.get("1");
+    small.get("3");
+    EXPECT_EQ(small.size(), 2);
+    EXPECT_EQ(small.stats().evictions, 1);
+    small.get("1");
+    EXPECT_EQ(small.stats().hits, 2);
+    small.get("2");
+    EXPECT_EQ(small.stats().misses, 4);
+    EXPECT_EQ(one->value, 1);
+
+    calc::compilation_cache compiled(64);
+    auto f = compiled.get("x * x + y");
+    ASSERT_TRUE(f->value.has_value());
+    EXPECT_EQ(compiled.get(" x*x+y ")->value->evaluate({3, 1}), 10);
+    EXPECT_EQ(compiled.get("x +")->value.error().get_err_type(), EXPECTED_TOKEN);
+
+    // the errors of an evaluation too
+    const std::string_view div = " y /  (x - x)";
+    const auto div_err = calc::locate(compiled.get(div)->value->evaluate({1, 2}).error(), div);
+    EXPECT_EQ(div_err.get_start(), 3);
+    EXPECT_EQ(div_err.get_end(), 4);
+
+    // concurrent lookups of overlapping expressions
+    calc::evaluation_cache shared(16);
+    std::vector<std::jthread> threads;
+    std::atomic<size_t> wrong = 0;
+    for(size_t t = 0; t < 4; ++t){
+        threads.emplace_back([&, t]{
+            for(size_t i = 0; i < 2000; ++i){
+                const size_t n = (i * (t + 1)) % 40;
+                auto e = shared.get(std::to_string(n) + " * 2");
+                wrong += !(e->value == static_cast<calc::num_t>(n * 2));
+            }
+        });
+    }
+    threads.clear();
+
+    EXPECT_EQ(wrong, 0);
+    EXPECT_EQ(shared.stats().hits + shared.stats().misses, 8000);
+    EXPECT_LE(shared.size(), shared.capacity());
+}
+
+TEST(calc_test, shared_subexpressions){
+    static constexpr std::array<calc::num_t, 5> xs{1, -2.5, 0, 3, 4};
+    static constexpr std::array<calc::num_t, 5> ys{2, 2, 0, 0.5, -1};
+
+    static_assert(consistent("x + y", xs, ys, deduplicate) == 0);
+    static_assert(consistent("x * x", xs, ys, deduplicate) == 1);
+    static_assert(consistent("2 * x + 2", xs, ys, deduplicate) == 1);
+    static_assert(consistent("abs(x - y) * abs(x - y) + abs(x - y)", xs, ys, deduplicate) == 8);
+    static_assert(consistent("(x + y)! / (x + y)! - (y + x)", xs, ys, deduplicate) == 6);
+    // the error of a shared subtree is the one of its first occurrence
+    static_assert(consistent("1 / (x - y) + 1 / (x - y)", xs, ys, deduplicate) == 5);
+    static_assert(consistent("x / 0 + x / 0 * y", xs, ys, deduplicate) == 3);
+
+    auto c = calc::compile("abs(x - y) * abs(x - y) + abs(x - y)");
+    ASSERT_TRUE(c.has_value());
+    EXPECT_EQ(c->deduplicate(), 8);
+    EXPECT_EQ(c->syntax_tree().nodes.size(), 6);
+    EXPECT_EQ(c->bytecode().registers, 1);
+    EXPECT_EQ(std::ranges::count(c->bytecode().code, calc::OPCODE::LOAD, &calc::instruction::op), 2);
+    EXPECT_EQ(c->evaluate({1, 4}), 12);
+    EXPECT_EQ(c->deduplicate(), 0);
+
+    auto d = calc::compile("x / (y - y) + x / (y - y)");
+    ASSERT_TRUE(d.has_value());
+    d->deduplicate();
+    const auto err = d->evaluate({1, 2});
+    ASSERT_FALSE(err.has_value());
+    EXPECT_EQ(err.error().get_err_type(), calc::calc_err_type_t::DIVISION_BY_ZERO);
+    EXPECT_EQ(err.error().get_start(), 2);
+
+    // simplify keeps the subtrees shared
+    auto e = calc::compile("(x * 2 * 1) * (x * 2 * 1) - 0");
+    ASSERT_TRUE(e.has_value());
+    EXPECT_EQ(e->deduplicate(), 5);
+    EXPECT_EQ(e->simplify(), 4);
+    EXPECT_EQ(e->syntax_tree().nodes.size(), 4);
+    EXPECT_EQ(e->evaluate({3}), 36);
+
+    // batch evaluation with the registers
+    std::vector<calc::num_t> many_x, many_y;
+    for(int i = 0; i < 1000; ++i){
+        many_x.push_back(i % 7 - 3);
+        many_y.push_back(i % 11 * 0.5);
+    }
+    auto f = calc::compile("(x - y) ^ 2 + floor(x - y) * (x - y)", {"x", "y"});
+    ASSERT_TRUE(f.has_value());
+    EXPECT_EQ(f->deduplicate(), 6);
+    const std::array<std::span<const calc::num_t>, 2> columns{many_x, many_y};
+    std::vector<calc::num_t> out(many_x.size());
+    std::vector<calc::lane_err> errors(many_x.size());
+    ASSERT_FALSE(f->evaluate_batch(columns, out, errors).has_value());
+    for(size_t i = 0; i < out.size(); ++i){
+        EXPECT_EQ(f->evaluate({many_x[i], many_y[i]}), out[i]);
+    }
+}
+
+template<typename T>
+constexpr bool fails_with(const calc::basic_evaluation_t<T>& res, calc::calc_err_type_t type){
+    return !res && res.error().get_err_type() == type;
+}
+
+TEST(calc_test, numeric_types){
+    using enum calc::calc_err_type_t;
+
+    // float: narrower range, overflows sooner
+    static_assert(calc::basic_evaluate<float>("1 + 2 * 3") == 7.f);
+    static_assert(calc::basic_evaluate<float>("0.1") == 0.1f);
+    static_assert(calc::basic_evaluate<float>("34!") == calc::math_utils::factorials<float>[34]);
+    static_assert(fails_with(calc::basic_evaluate<float>("35!"), OVERFLOW_UNDERFLOW));
+    EXPECT_TRUE(fails_with(calc::basic_evaluate<float>("1e30 * 1e30"), OVERFLOW_UNDERFLOW));
+    static_assert(fails_with(calc::basic_evaluate<float>("1e39"), INVALID_LITERAL));
+    static_assert(fails_with(calc::basic_evaluate<float>("1 / 0"), DIVISION_BY_ZERO));
+    static_assert(calc::math_utils::epsilon<float> > calc::math_utils::epsilon<double>);
+
+    // long double: wider range
+    EXPECT_TRUE(calc::basic_evaluate<long double>("1e308 * 10").has_value());
+    EXPECT_TRUE(calc::basic_evaluate<long double>("171!").has_value());
+    EXPECT_EQ(calc::basic_evaluate<long double>("0.1"), 0.1L);
+    EXPECT_EQ(calc::basic_evaluate<long double>("2 ^ -3"), 0.125L);
+
+    // int64_t: exact and checked
+    static_assert(calc::basic_evaluate<int64_t>("9007199254740993 + 0") == 9007199254740993);
+    static_assert(calc::basic_evaluate<int64_t>("9223372036854775807") == INT64_MAX);
+    static_assert(calc::basic_evaluate<int64_t>("-9223372036854775807 - 1") == INT64_MIN);
+    static_assert(fails_with(calc::basic_evaluate<int64_t>("9223372036854775807 + 1"), OVERFLOW_UNDERFLOW));
+    static_assert(fails_with(calc::basic_evaluate<int64_t>("-(-9223372036854775807 - 1)"), OVERFLOW_UNDERFLOW));
+    static_assert(fails_with(calc::basic_evaluate<int64_t>("abs(-9223372036854775807 - 1)"), OVERFLOW_UNDERFLOW));
+    static_assert(fails_with(calc::basic_evaluate<int64_t>("(-9223372036854775807 - 1) / -1"), OVERFLOW_UNDERFLOW));
+    static_assert(fails_with(calc::basic_evaluate<int64_t>("9223372036854775808"), INVALID_LITERAL));
+    static_assert(fails_with(calc::basic_evaluate<int64_t>("1.5"), INVALID_LITERAL));
+    static_assert(fails_with(calc::basic_evaluate<int64_t>("1 / 0"), DIVISION_BY_ZERO));
+    static_assert(calc::basic_evaluate<int64_t>("7 / 2 + -7 / 2") == 0);
+    static_assert(calc::basic_evaluate<int64_t>("20!") == 2432902008176640000);
+    static_assert(fails_with(calc::basic_evaluate<int64_t>("21!"), OVERFLOW_UNDERFLOW));
+    static_assert(calc::basic_evaluate<int64_t>("2 ^ 62") == int64_t{1} << 62);
+    static_assert(fails_with(calc::basic_evaluate<int64_t>("2 ^ 63"), OVERFLOW_UNDERFLOW));
+    static_assert(calc::basic_evaluate<int64_t>("(-2) ^ 63") == INT64_MIN);
+    static_assert(calc::basic_evaluate<int64_t>("2 ^ -1 + (-1) ^ -3 + 1 ^ (-9223372036854775807 - 1)") == 0);
+    static_assert(fails_with(calc::basic_evaluate<int64_t>("0 ^ -1"), DIVISION_BY_ZERO));
+    static_assert(calc::basic_evaluate<int64_t>("abs(-3) * floor(4) - ceil(5)") == 7);
+
+    // compiled, simplified and in batches
+    auto f = calc::basic_compile<float>("x * y + 1 * 0.5", {"x", "y"});
+    ASSERT_TRUE(f.has_value());
+    EXPECT_EQ(f->simplify(), 2);
+    EXPECT_EQ(f->evaluate({2.f, 3.f}), 6.5f);
+    EXPECT_EQ(f->evaluate_tree(std::array{2.f, 3.f}), 6.5f);
+
+    std::vector<float> xs{1, 2, 3e20f}, ys{4, 5, 3e20f}, out(3);
+    std::vector<calc::lane_err> errors(3);
+    const std::array<std::span<const float>, 2> columns{xs, ys};
+    ASSERT_FALSE(f->evaluate_batch(columns, out, errors).has_value());
+    EXPECT_EQ(out[1], 10.5f);
+    EXPECT_EQ(errors[2], calc::lane_err::OVERFLOW_UNDERFLOW);
+
+    auto g = calc::basic_compile<int64_t>("x * x / y", {"x", "y"});
+    ASSERT_TRUE(g.has_value());
+    std::vector<int64_t> ixs{3, 5, 4000000000, 1}, iys{2, 0, 1, 1}, iout(4);
+    const std::array<std::span<const int64_t>, 2> icolumns{ixs, iys};
+    ASSERT_FALSE(g->evaluate_batch(icolumns, iout, errors = std::vector<calc::lane_err>(4)).has_value());
+    EXPECT_EQ(iout[0], 4);
+    EXPECT_EQ(errors[1], calc::lane_err::DIVISION_BY_ZERO);
+    EXPECT_EQ(errors[2], calc::lane_err::OVERFLOW_UNDERFLOW);
+    EXPECT_EQ(iout[3], 1);
+
+#ifdef __STDCPP_FLOAT16_T__
+    EXPECT_EQ(calc::basic_evaluate<std::float16_t>("1.5 * 4"), std::float16_t(6));
+    EXPECT_TRUE(fails_with(calc::basic_evaluate<std::float16_t>("9!"), OVERFLOW_UNDERFLOW));
+#endif
+#ifdef __STDCPP_BFLOAT16_T__
+    EXPECT_EQ(calc::basic_evaluate<std::bfloat16_t>("1.5 * 4"), std::bfloat16_t(6));
+#endif
+}
+
+TEST(calc_test, int_fast_path){
+    using enum calc::calc_err_type_t;
+
+    // 2^60 + 1 isn't a double, the integers are exact
+    static_assert(calc::evaluate("2^60 + 1 - 2^60") == 1);
+    static_assert(consistent("2^60 + 1 - 2^60"));
+    static_assert(calc::compile("2^60 + 1 - 2^60")->evaluate() == 1);
+    static_assert(calc::compile<"2^60 + 1 - 2^60">()() == 1);
+    static_assert(calc::evaluate("20! / 19! - 20") == 0);
+
+    // results which aren't integers or don't fit are floating point
+    static_assert(calc::evaluate("6 / 4") == 1.5);
+    static_assert(calc::evaluate("2 ^ -1") == 0.5);
+    static_assert(calc::evaluate("2^63") == 9223372036854775808.);
+    static_assert(calc::evaluate("21! / 20!") == 21);
+
+    // the sign of a zero is the floating point one
+    static_assert(std::signbit(*calc::evaluate("-0")));
+    static_assert(std::signbit(*calc::evaluate("0 * -3")));
+    static_assert(std::signbit(*calc::evaluate("0 / -3 + -0")));
+    static_assert(!std::signbit(*calc::evaluate("3 - 3")));
+    static_assert(consistent("x * 2 - 0 + -0", {-0.}, simplify) == 5);
+    static_assert(consistent("2^53 + 1 - 2^53", {}, simplify) == 8);
+    static_assert(consistent("2^60 + 1 - 2^60 + x", {1.5}, simplify) == 8);
+
+    // the errors don't change
+    static_assert(fails_with(calc::evaluate("1 / (2 - 2)"), DIVISION_BY_ZERO));
+    static_assert(calc::evaluate("1 / (2 - 2)").error().get_start() == 2);
+    static_assert(fails_with(calc::evaluate("171!"), OVERFLOW_UNDERFLOW));
+    static_assert(fails_with(calc::evaluate("(-1)!"), UNEXPECTED_VALUE));
+    static_assert(fails_with(calc::evaluate("0 ^ -1"), DIVISION_BY_ZERO));
+    static_assert(consistent("1 / (2 - 2)"));
+
+    // integer subtrees are folded when lowered
+    auto c = calc::compile("x * (2^60 + 1 - 2^60)");
+    ASSERT_TRUE(c.has_value());
+    EXPECT_EQ(c->bytecode().code.size(), 3);
+    EXPECT_EQ(c->evaluate({1.5}), 1.5);
+    EXPECT_EQ(c->evaluate_tree(std::array<calc::num_t, 1>{1.5}), 1.5);
+}
+
+TEST(calc_test, unchecked_evaluation){
+    using enum calc::calc_err_type_t;
+    constexpr auto inf = std::numeric_limits<calc::num_t>::infinity();
+    constexpr auto nan = std::numeric_limits<calc::num_t>::quiet_NaN();
+
+    // at run time evaluate() checks only the result, the errors must be
+    // the ones of the checked tree
+    EXPECT_TRUE(consistent("-(1 + 2) * 3! / 4 ^ 2 + abs(x) - floor(x) + ceil(x)", {-1.5}));
+    EXPECT_TRUE(consistent("1 / (1e200 * 1e200)"));
+    EXPECT_TRUE(consistent("1 / (x * x)", {1e200}));
+    EXPECT_TRUE(consistent("(x * x) ^ 0", {1e200}));
+    EXPECT_TRUE(consistent("(x * x - x * x)!", {1e200}));
+    EXPECT_TRUE(consistent("1 / x", {1e-13}));
+    EXPECT_TRUE(consistent("0 / (x - x) + 1", {2}));
+    EXPECT_TRUE(consistent("x ^ 0.5", {2}));
+    EXPECT_TRUE(consistent("(-x)! + 1", {2}));
+    EXPECT_TRUE(consistent("1 + x + y", {2}));
+    EXPECT_TRUE(consistent("x ^ 0", {inf}));
+    EXPECT_TRUE(consistent("floor(x)", {-inf}));
+    EXPECT_TRUE(consistent("x + 1", {inf}));
+
+    auto c = calc::compile("1 / (x * x)");
+    ASSERT_TRUE(c.has_value());
+    EXPECT_EQ(c->evaluate({2}), 0.25);
+    EXPECT_EQ(c->evaluate({1e200}).error().get_err_type(), OVERFLOW_UNDERFLOW);
+    EXPECT_EQ(c->evaluate({1e200}).error().get_start(), 7);
+    EXPECT_EQ(c->evaluate({0}).error().get_err_type(), DIVISION_BY_ZERO);
+    EXPECT_TRUE(std::isnan(calc::compile("abs(x)")->evaluate({nan}).value()));
+}
+
+TEST(calc_test, limits){
+    using enum calc::calc_err_type_t;
+
+    // 0 is no limit
+    static_assert(calc::evaluate("1 + 2 * 3", calc::limits{}) == 7);
+
+    static_assert(calc::evaluate("1 + 22", {.length = 6}) == 23);
+    static_assert(fails_with(calc::evaluate("1 + 22", {.length = 5}), LIMIT_EXCEEDED));
+    static_assert(calc::evaluate("1 + 22", {.length = 5}).error().get_start() == 5);
+    static_assert(calc::evaluate("1 + 22", {.length = 5}).error().get_end() == 6);
+
+    static_assert(calc::evaluate("1 + 2 + 3", {.tokens = 5}) == 6);
+    static_assert(fails_with(calc::evaluate("1 + 2 + 3", {.tokens = 4}), LIMIT_EXCEEDED));
+    static_assert(calc::evaluate("1 + 2 + 3", {.tokens = 4}).error().get_start() == 8);
+
+    // '+' waits for abs(1), abs for its bracket and the bracket for 1
+    static_assert(calc::evaluate("((1)) + abs(1)", {.depth = 3}) == 2);
+    static_assert(calc::evaluate("((1)) + abs(1)", {.depth = 2}).error().get_start() == 11);
+    static_assert(calc::evaluate("((1))", {.depth = 1}).error().get_start() == 1);
+    static_assert(fails_with(calc::evaluate("abs(1)", {.depth = 1}), LIMIT_EXCEEDED));
+    static_assert(calc::evaluate("2 ^ 2 ^ 2", {.depth = 1}).error().get_start() == 6);
+    static_assert(calc::evaluate("1 + 2 + 3 + 4", {.depth = 1}) == 10);
+
+    // one step per operator, a power one more per bit of the exponent
+    static_assert(calc::evaluate("1.5 + 2.5 * 3", {.steps = 2}) == 9);
+    static_assert(calc::evaluate("1.5 + 2.5 * 3", {.steps = 1}).error().get_start() == 4);
+    static_assert(calc::evaluate("1.0000001 ^ 99999999", {.steps = 28}).has_value());
+    static_assert(fails_with(calc::evaluate("1.0000001 ^ 99999999", {.steps = 27}), LIMIT_EXCEEDED));
+
+    // hostile input stops early
+    const std::string open(1000000, '(');
+    const auto deep = calc::evaluate(open, {.depth = 100});
+    ASSERT_TRUE(fails_with(deep, LIMIT_EXCEEDED));
+    EXPECT_EQ(deep.error().get_start(), 100);
+    EXPECT_TRUE(fails_with(calc::evaluate(open, {.length = 4096}), LIMIT_EXCEEDED));
+
+    // every evaluation of a compiled expression has the whole budget,
+    // the constants folded when compiling are free
+    auto c = calc::compile("x ^ y * (2 + 3)", {.steps = 10});
+    ASSERT_TRUE(c.has_value());
+    for(int i = 0; i < 3; ++i){
+        EXPECT_EQ(c->evaluate({2, 8}), 1280);
+    }
+    EXPECT_EQ(c->evaluate({1, 1e6}).error().get_err_type(), LIMIT_EXCEEDED);
+    EXPECT_EQ(c->evaluate({1, 1e6}).error().get_start(), 2);
+    EXPECT_EQ(c->evaluate_tree(std::array<calc::num_t, 2>{1, 1e6}).error().get_start(), 2);
+    EXPECT_EQ(c->evaluate_tree(std::array<calc::num_t, 2>{2, 8}), 1280);
+    EXPECT_EQ(calc::compile("x ^ y", {.tokens = 2}).error().get_err_type(), LIMIT_EXCEEDED);
+
+    // the same for every evaluator: exact integer formulas are free
+    static_assert(calc::evaluate("2 ^ 62 + 1 - 2 * 3", {.steps = 1}) == 4611686018427387899.);
+    static_assert(calc::compile("2 ^ 62 + 1 - 2 * 3", {.steps = 1})->evaluate() == 4611686018427387899.);
+    static_assert(calc::compile("2 ^ 62 + 1 - 2 * 3", {.steps = 1})->evaluate_tree() == 4611686018427387899.);
+    static_assert(fails_with(calc::evaluate("6 / 4 + 1", {.steps = 1}), LIMIT_EXCEEDED));
+    static_assert(fails_with(calc::compile("6 / 4 + 1", {.steps = 1})->evaluate_tree(), LIMIT_EXCEEDED));
+    static_assert(fails_with(calc::compile("6 / 4 + 1", {.steps = 1})->evaluate(), LIMIT_EXCEEDED));
+}
+
+// every operator, over x, y and small literals
+std::string random_expression(std::mt19937_64& rng, int depth){
+    if(depth == 0 || rng() % 4 == 0){
+        switch(rng() % 4){
+        case 0:
+            return "x";
+        case 1:
+            return "y";
+        default:
+            return std::to_string(rng() % 7) + (rng() % 2 ? ".5" : "");
+        }
+    }
+
+    const auto sub = [&]{
+        return random_expression(rng, depth - 1);
+    };
+
+    switch(rng() % 11){
+    case 0:
+        return "(" + sub() + " + " + sub() + ")";
+    case 1:
+        return "(" + sub() + " - " + sub() + ")";
+    case 2:
+        return "(" + sub() + " * " + sub() + ")";
+    case 3:
+        return "(" + sub() + " / " + sub() + ")";
+    case 4:
+        return "(" + sub() + " ^ " + (rng() % 2 ? sub() : std::to_string(rng() % 5)) + ")";
+    case 5:
+        return "(" + sub() + ")!";
+    case 6:
+        return "abs(" + sub() + ")";
+    case 7:
+        return "floor(" + sub() + ")";
+    case 8:
+        return "ceil(" + sub() + ")";
+    case 9:
+        return "-(" + sub() + ")";
+    default:
+        return "(" + sub() + " * 1e200 * 1e200)";
+    }
+}
+
+TEST(calc_test, jit){
+    using enum calc::calc_err_type_t;
+
+    auto c = calc::compile("-x + abs(y) - floor(x) * ceil(y) + x ^ 3 + 3! / y", {"x", "y"});
+    ASSERT_TRUE(c.has_value());
+    const calc::jit_expression j(*c);
+#if CALC_JIT_NATIVE
+    ASSERT_TRUE(j.native());
+    EXPECT_EQ(j.function()(std::array{2.5, -1.5}.data()), *c->evaluate({2.5, -1.5}));
+    EXPECT_TRUE(std::isnan(j.function()(std::array{2.5, 0.}.data())));
+#endif
+    EXPECT_TRUE(same_result(j.evaluate({2.5, -1.5}), c->evaluate({2.5, -1.5})));
+    EXPECT_EQ(j.evaluate({2.5, 0}).error().get_err_type(), DIVISION_BY_ZERO);
+    EXPECT_EQ(j.evaluate({2.5}).error().get_err_type(), UNBOUND_VARIABLE);
+
+    // the native code doesn't count the steps, the bytecode runs
+    auto limited = calc::compile("x ^ y", {.steps = 10});
+    const calc::jit_expression l(*limited);
+    EXPECT_FALSE(l.native());
+    EXPECT_EQ(l.evaluate({1, 1e6}).error().get_err_type(), LIMIT_EXCEEDED);
+
+    // differential: same results and errors as the tree, and the native
+    // result is finite exactly when the tree succeeds
+    std::mt19937_64 rng(7);
+    const std::array<std::array<calc::num_t, 2>, 5> values{{
+        {2, 3}, {-1.5, 0.5}, {0, 4}, {1e200, -2}, {3, 3},
+    }};
+
+    for(size_t i = 0; i < 2000; ++i){
+        const auto str = random_expression(rng, 6);
+        auto e = calc::compile(str, {"x", "y"});
+        ASSERT_TRUE(e.has_value()) << str;
+        if(i % 2){
+            e->deduplicate();
+        }
+
+        const calc::jit_expression f(*e);
+        for(const auto& v : values){
+            const auto tree = e->evaluate_tree(v);
+            EXPECT_TRUE(same_result(f.evaluate(v), tree)) << str;
+
+            if(f.native()){
+                EXPECT_EQ(std::isfinite(f.function()(v.data())), tree.has_value()) << str;
+            }
+        }
+    }
+}
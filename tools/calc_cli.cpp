@@ -0,0 +1,343 @@
+// evaluates a file of newline separated expressions, one result per line in
+// the same order. The input is memory mapped and split in chunks of whole
+// lines which the threads of a pool evaluate into their own buffers, the
+// buffers are then written in input order
+//
+//     calc_cli [--binary] [--threads N] [--quiet] input output
+//
+// output can be - for the standard output. Text output is one line per
+// expression: the value, or "error TYPE start end" (the span is missing for
+// errors without one). Binary output is one record per expression, see
+// binary_record. Throughput is reported on the standard error
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <cstring>
+#include <limits>
+#include <optional>
+#include <print>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "constexpr-calculator/calculator.hpp"
+
+namespace{
+
+    // native byte order. status is 0 when value is valid, otherwise the
+    // calc_err_type_t of the error plus one. Without a span start and end
+    // are UINT32_MAX
+    struct binary_record{
+        calc::num_t value;
+        uint32_t start;
+        uint32_t end;
+        uint8_t status;
+        std::array<uint8_t, 7> padding;
+    };
+
+    static_assert(sizeof(binary_record) == 24);
+
+    constexpr std::array error_names{
+        "UNKNOWN_TOKEN",
+        "EMPTY_EXPRESSION",
+        "INVALID_LITERAL",
+        "EXPECTED_TOKEN",
+        "UNEXPECTED_TOKEN",
+        "INVALID_EXPR",
+        "DIVISION_BY_ZERO",
+        "OVERFLOW_UNDERFLOW",
+        "UNEXPECTED_VALUE",
+        "UNKNOWN_VARIABLE",
+        "UNBOUND_VARIABLE",
+        "LIMIT_EXCEEDED",
+    };
+
+    static_assert(error_names.size() == static_cast<size_t>(calc::calc_err_type_t::LIMIT_EXCEEDED) + 1);
+
+    struct options{
+        bool binary = false;
+        bool quiet = false;
+        size_t threads = std::thread::hardware_concurrency();
+        std::string input;
+        std::string output;
+    };
+
+    std::optional<options> parse_options(int argc, char** argv){
+        options ret;
+        std::vector<std::string_view> files;
+
+        for(int i = 1; i < argc; ++i){
+            const std::string_view arg = argv[i];
+
+            if(arg == "--binary"){
+                ret.binary = true;
+            }
+            else if(arg == "--quiet"){
+                ret.quiet = true;
+            }
+            else if(arg == "--threads" && i + 1 < argc){
+                const std::string_view n = argv[++i];
+                auto [_, ec] = std::from_chars(n.data(), n.data() + n.size(), ret.threads);
+                if(ec != std::errc{} || ret.threads == 0){
+                    return std::nullopt;
+                }
+            }
+            else if(arg.size() > 1 && arg.starts_with('-')){
+                return std::nullopt;
+            }
+            else{
+                files.push_back(arg);
+            }
+        }
+
+        if(files.size() != 2){
+            return std::nullopt;
+        }
+
+        ret.input = files[0];
+        ret.output = files[1];
+
+        return ret;
+    }
+
+    // read only view of a whole file
+    class mapped_file{
+        int fd = -1;
+        void* data = MAP_FAILED;
+        size_t size = 0;
+
+    public:
+        explicit mapped_file(const std::string& path){
+            fd = ::open(path.c_str(), O_RDONLY);
+            if(fd < 0){
+                return;
+            }
+
+            struct stat st{};
+            if(::fstat(fd, &st) != 0){
+                return;
+            }
+
+            size = static_cast<size_t>(st.st_size);
+            // an empty file can't be mapped, it is just empty
+            if(size == 0){
+                return;
+            }
+
+            data = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if(data != MAP_FAILED){
+                ::madvise(data, size, MADV_SEQUENTIAL);
+            }
+        }
+
+        mapped_file(const mapped_file&) = delete;
+        mapped_file& operator=(const mapped_file&) = delete;
+
+        ~mapped_file(){
+            if(data != MAP_FAILED){
+                ::munmap(data, size);
+            }
+            if(fd >= 0){
+                ::close(fd);
+            }
+        }
+
+        bool ok() const {
+            return fd >= 0 && (size == 0 || data != MAP_FAILED);
+        }
+
+        std::string_view view() const {
+            if(size == 0){
+                return {};
+            }
+
+            return std::string_view(static_cast<const char*>(data), size);
+        }
+    };
+
+    bool write_all(int fd, std::string_view buf){
+        while(!buf.empty()){
+            const auto n = ::write(fd, buf.data(), buf.size());
+            if(n < 0){
+                if(errno == EINTR){
+                    continue;
+                }
+                return false;
+            }
+
+            buf.remove_prefix(static_cast<size_t>(n));
+        }
+
+        return true;
+    }
+
+    void append_text(std::string& out, const calc::evaluation_t& res){
+        std::array<char, 64> buf{};
+
+        if(res){
+            auto [end, _] = std::to_chars(buf.data(), buf.data() + buf.size(), *res);
+            out.append(buf.data(), end);
+            out += '\n';
+            return;
+        }
+
+        const auto& err = res.error();
+        out += "error ";
+        out += error_names[static_cast<size_t>(err.get_err_type())];
+
+        if(err.get_start()){
+            for(auto pos : {*err.get_start(), *err.get_end()}){
+                auto [end, _] = std::to_chars(buf.data(), buf.data() + buf.size(), pos);
+                out += ' ';
+                out.append(buf.data(), end);
+            }
+        }
+
+        out += '\n';
+    }
+
+    void append_binary(std::string& out, const calc::evaluation_t& res){
+        binary_record r{};
+
+        if(res){
+            r.value = *res;
+            r.start = UINT32_MAX;
+            r.end = UINT32_MAX;
+        }
+        else{
+            const auto& err = res.error();
+            r.value = std::numeric_limits<calc::num_t>::quiet_NaN();
+            r.start = static_cast<uint32_t>(err.get_start().value_or(UINT32_MAX));
+            r.end = static_cast<uint32_t>(err.get_end().value_or(UINT32_MAX));
+            r.status = static_cast<uint8_t>(static_cast<uint8_t>(err.get_err_type()) + 1);
+        }
+
+        out.append(reinterpret_cast<const char*>(&r), sizeof(r));
+    }
+
+    // evaluates every line of chunk into out, returns the number of lines.
+    // The parser keeps its buffers from one line to the next
+    size_t evaluate_chunk(std::string_view chunk, calc::parser& p, std::string& out, bool binary){
+        size_t lines = 0;
+
+        while(!chunk.empty()){
+            const auto nl = chunk.find('\n');
+            auto line = chunk.substr(0, nl);
+            chunk.remove_prefix(nl == std::string_view::npos ? chunk.size() : nl + 1);
+
+            if(line.ends_with('\r')){
+                line.remove_suffix(1);
+            }
+
+            const auto res = p.evaluate(line);
+            if(binary){
+                append_binary(out, res);
+            }
+            else{
+                append_text(out, res);
+            }
+
+            ++lines;
+        }
+
+        return lines;
+    }
+
+    // bytes of input per chunk, the end is moved to the next newline
+    constexpr size_t chunk_bytes = 1 << 20;
+    // chunks evaluated before their output is written, per thread
+    constexpr size_t chunks_per_thread = 4;
+}
+
+int main(int argc, char** argv){
+    const auto opt = parse_options(argc, argv);
+    if(!opt){
+        std::println(stderr, "usage: {} [--binary] [--threads N] [--quiet] input output", argv[0]);
+        return 2;
+    }
+
+    const mapped_file input(opt->input);
+    if(!input.ok()){
+        std::println(stderr, "cannot read {}: {}", opt->input, std::strerror(errno));
+        return 1;
+    }
+
+    const bool to_stdout = opt->output == "-";
+    const int out_fd = to_stdout ?
+        STDOUT_FILENO :
+        ::open(opt->output.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(out_fd < 0){
+        std::println(stderr, "cannot write {}: {}", opt->output, std::strerror(errno));
+        return 1;
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+
+    calc::thread_pool pool(opt->threads);
+    std::vector<calc::parser> parsers(pool.size());
+
+    const auto data = input.view();
+    const size_t window = pool.size() * chunks_per_thread;
+
+    std::vector<std::string_view> chunks;
+    std::vector<std::string> outputs(window);
+    std::vector<size_t> lines(window);
+    size_t total_lines = 0;
+    size_t pos = 0;
+    bool written = true;
+
+    while(written && pos < data.size()){
+        chunks.clear();
+        while(chunks.size() < window && pos < data.size()){
+            size_t end = std::min(pos + chunk_bytes, data.size());
+            const auto nl = data.find('\n', end);
+            end = nl == std::string_view::npos ? data.size() : nl + 1;
+
+            chunks.push_back(data.substr(pos, end - pos));
+            pos = end;
+        }
+
+        pool.parallel_for(chunks.size(), [&](size_t thread, size_t c){
+            outputs[c].clear();
+            lines[c] = evaluate_chunk(chunks[c], parsers[thread], outputs[c], opt->binary);
+        });
+
+        for(size_t c = 0; c < chunks.size() && written; ++c){
+            written = write_all(out_fd, outputs[c]);
+            total_lines += lines[c];
+        }
+    }
+
+    if(!written || (!to_stdout && ::close(out_fd) != 0)){
+        std::println(stderr, "cannot write {}: {}", opt->output, std::strerror(errno));
+        return 1;
+    }
+
+    const auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    if(!opt->quiet){
+        const double seconds = std::max(elapsed, 1e-9);
+
+        std::println(
+            stderr,
+            "{} lines, {} bytes in {} ms: {} lines/s, {} MB/s, {} threads",
+            total_lines,
+            data.size(),
+            static_cast<uint64_t>(elapsed * 1000),
+            static_cast<uint64_t>(static_cast<double>(total_lines) / seconds),
+            static_cast<uint64_t>(static_cast<double>(data.size()) / 1e6 / seconds),
+            pool.size()
+        );
+    }
+
+    return 0;
+}
@@ -0,0 +1,70 @@
+#!/usr/bin/env python3
+# writes src/pow5_table.hpp: 5^q for q in [-342, 308], normalised to 128 bits
+# so the most significant bit is set. Positive powers are truncated, negative
+# ones are the reciprocal rounded up. Used by the Eisel-Lemire number parser
+import os
+import sys
+
+MIN_Q = -342
+MAX_Q = 308
+
+
+def entry(q):
+    if q >= 0:
+        p = 5 ** q
+        while p < (1 << 127):
+            p *= 2
+        while p >= (1 << 128):
+            p //= 2
+        return p
+
+    p = 5 ** -q
+    z = p.bit_length()
+    if q >= -27:
+        c = 2 ** (z + 127) // p + 1
+    else:
+        c = 2 ** (2 * z + 2 * 64) // p + 1
+        while c >= (1 << 128):
+            c //= 2
+    return c
+
+
+def main():
+    out = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "src", "pow5_table.hpp")
+    if len(sys.argv) > 1:
+        out = sys.argv[1]
+
+    lines = []
+    for q in range(MIN_Q, MAX_Q + 1):
+        c = entry(q)
+        lines.append("        0x{:016x}, 0x{:016x},".format(c >> 64, c & ((1 << 64) - 1)))
+
+    with open(out, "w") as f:
+        f.write("""#ifndef _MY_POW5_TABLE_
+#define _MY_POW5_TABLE_
+
+#include <array>
+#include <cstdint>
+
+// generated by tools/gen_pow5_table.py, do not edit
+namespace calc{
+namespace{
+namespace pow5{
+    static constexpr int min_exponent = %d;
+    static constexpr int max_exponent = %d;
+
+    // 5^q as 128 bits with the highest one set: table[2 * (q - min_exponent)]
+    // is the high half, the next one the low half
+    static constexpr std::array<uint64_t, %d> table{
+%s
+    };
+}
+}
+}
+
+#endif
+""" % (MIN_Q, MAX_Q, 2 * (MAX_Q - MIN_Q + 1), "\n".join(lines)))
+
+
+if __name__ == "__main__":
+    main()